@@ -8,6 +8,13 @@
 #define SCR_SIZE ((SCR_WIDTH) * (SCR_HEIGHT))
 #define VMEM_ADDR  ((uint8_t*)0xA0000)
 
+/* Draw into the back page of the 128KB VGA window and flip pages with
+ * the CRTC start address in display_buffer(), instead of copying the
+ * whole frame. The video mapping must cover the whole window.
+ */
+//#define PAGE_FLIP
+#define PAGE_SIZE_VGA 0x10000
+
 extern uint8_t *vmem;
 
 static inline void
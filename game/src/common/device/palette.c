@@ -6,18 +6,20 @@
 #define VGA_DAC_WRITE_INDEX 0x3C8
 #define VGA_DAC_DATA 0x3C9
 
+/* The palette window of NEMU, which takes the entries
+ * as {red, green, blue, unused} with 8 bits per component. */
+#define VGA_PALETTE_ADDR 0xc0000
+
 /* The number of entries in the palette. */
 #define NR_PALETTE_ENTRY 256
 
 /* Load the palette into VGA. */
 void write_palette(void *colors, int nr_color) {
 	int i;
-	uint8_t (*palette)[4] = colors;
-	out_byte(VGA_DAC_WRITE_INDEX, 0);
+	uint32_t *palette = colors;
+	volatile uint32_t *window = (void *)VGA_PALETTE_ADDR;
 	for(i = 0; i < nr_color; i ++) {
-		out_byte(VGA_DAC_DATA, palette[i][0] >> 2);	// red
-		out_byte(VGA_DAC_DATA, palette[i][1] >> 2);	// green
-		out_byte(VGA_DAC_DATA, palette[i][2] >> 2);	// blue
+		window[i] = palette[i];
 	}
 }
 
@@ -1,12 +1,24 @@
 #include "common.h"
 #include "device/video.h"
+#include "x86.h"
 
 #include <string.h>
 
 extern char font8x8_basic[128][8];
 
+#ifdef PAGE_FLIP
+#define VGA_CRTC_INDEX 0x3D4
+#define VGA_CRTC_DATA 0x3D5
+#define START_ADDR_HIGH 0x0C
+#define START_ADDR_LOW 0x0D
+
+/* the page being drawn, the other one is on the screen */
+static int back_page = 1;
+uint8_t *vmem = VMEM_ADDR + PAGE_SIZE_VGA;
+#else
 static uint8_t vbuf[SCR_SIZE];
 uint8_t *vmem = vbuf;
+#endif
 
 void
 prepare_buffer(void) {
@@ -15,7 +27,19 @@ prepare_buffer(void) {
 
 void
 display_buffer(void) {
+#ifdef PAGE_FLIP
+	/* The start address counts 4-byte units. */
+	uint32_t start = back_page * PAGE_SIZE_VGA / 4;
+	out_byte(VGA_CRTC_INDEX, START_ADDR_HIGH);
+	out_byte(VGA_CRTC_DATA, start >> 8);
+	out_byte(VGA_CRTC_INDEX, START_ADDR_LOW);
+	out_byte(VGA_CRTC_DATA, start & 0xff);
+
+	back_page = !back_page;
+	vmem = VMEM_ADDR + back_page * PAGE_SIZE_VGA;
+#else
 	asm volatile ("cld; rep movsl" : : "c"(SCR_SIZE / 4), "S"(vmem), "D"(VMEM_ADDR));
+#endif
 }
 
 static inline void
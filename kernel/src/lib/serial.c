@@ -3,6 +3,9 @@
 
 #define SERIAL_PORT  0x3F8
 
+/* the size of the transmit FIFO of 16550 */
+#define SERIAL_FIFO_SIZE 16
+
 void
 init_serial(void) {
 	out_byte(SERIAL_PORT + 1, 0x00);
@@ -14,6 +17,7 @@ init_serial(void) {
 	out_byte(SERIAL_PORT + 4, 0x0B);
 }
 
+/* The transmit FIFO is empty. */
 static inline int
 serial_idle(void) {
 	return (in_byte(SERIAL_PORT + 5) & 0x20) != 0;
@@ -24,3 +28,17 @@ serial_printc(char ch) {
 	while (!serial_idle());
 	out_byte(SERIAL_PORT, ch);
 }
+
+/* Fill the FIFO in bursts, instead of waiting for it before each byte. */
+void
+serial_write(const char *buf, int len) {
+	int i;
+	while (len > 0) {
+		while (!serial_idle());
+		for (i = 0; i < SERIAL_FIFO_SIZE && i < len; i ++) {
+			out_byte(SERIAL_PORT, buf[i]);
+		}
+		buf += i;
+		len -= i;
+	}
+}
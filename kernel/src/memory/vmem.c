@@ -13,6 +13,9 @@ void create_video_mapping() {
 	 * [0xa0000, 0xa0000 + SCR_SIZE) to physical memory area 
 	 * [0xa0000, 0xa0000 + SCR_SIZE) for user program. You may define
 	 * some page tables to create this mapping.
+	 * If the game uses PAGE_FLIP, map the whole 128KB VGA window
+	 * [0xa0000, 0xc0000) instead. The palette window of write_palette()
+	 * is the page at 0xc0000, which should be mapped in the same way.
 	 */
 	panic("please implement me");
 }
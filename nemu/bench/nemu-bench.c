@@ -0,0 +1,325 @@
+#include "nemu.h"
+#include "cpu/ifetch.h"
+#include "device/mmio.h"
+#include "device/port-io.h"
+#include "device/vga-scale.h"
+#include "memory/vmem-dirty.h"
+#include "monitor/expr.h"
+
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Microbenchmarks of the layers of NEMU, each one called directly
+ * without the monitor and the CPU loop:
+ *   nemu-bench [-n SAMPLES] [-s STREAM] [NAME...]
+ * Each benchmark is timed in SAMPLES samples of a batch of operations,
+ * and the time per operation is reported with its percentiles over the
+ * samples. Only the benchmarks whose names begin with one of NAME are
+ * run. The decoder runs the instructions recorded from the raw binary
+ * STREAM (see `make nemu-bench').
+ */
+
+#define STREAM_ADDR 0x100000
+#define MAX_STREAM (1 << 20)
+#define NR_ADDR 4096
+#define SAMPLE_NS 50000		/* the least time of a sample */
+
+#define CTR_ROW 200
+#define CTR_COL 320
+
+void init_machine(uint32_t);
+void init_ddr3();
+void init_regex();
+int exec(swaddr_t);
+uint32_t dram_read(hwaddr_t, size_t);
+void dram_write(hwaddr_t, size_t, uint32_t);
+
+static int nr_sample = 100;
+static char *stream_file = NULL;
+
+/* the eip of each instruction recorded from the stream */
+static swaddr_t *stream;
+static int stream_len;
+static CPU_state stream_cpu;
+
+static hwaddr_t seq_addr[NR_ADDR], rand_addr[NR_ADDR];
+
+static uint8_t frame[CTR_ROW][CTR_COL];
+static uint32_t screen[2 * CTR_ROW][2 * CTR_COL];
+static uint32_t pal[256];
+
+/* keeps the results, so that the reads are not optimized away */
+static volatile uint32_t sink;
+
+static uint64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Run the stream from its start, and record the eip of each instruction
+ * until the trap. The trap itself is not recorded.
+ */
+static void record_stream() {
+	FILE *fp = fopen(stream_file, "rb");
+	Assert(fp, "Can not open '%s'", stream_file);
+	int ret = fread(hwa_to_va(STREAM_ADDR), 1, hw_mem_size - STREAM_ADDR, fp);
+	fclose(fp);
+	Assert(ret > 0, "'%s' is empty", stream_file);
+	ifb_flush();
+
+	stream = malloc(sizeof(stream[0]) * MAX_STREAM);
+	assert(stream);
+	cpu.eip = STREAM_ADDR;
+	stream_cpu = cpu;
+	while(stream_len < MAX_STREAM && swaddr_read(cpu.eip, 1) != 0xd6) {
+		stream[stream_len ++] = cpu.eip;
+		cpu.eip += exec(cpu.eip);
+	}
+	Assert(stream_len > 0, "no instruction before the trap in '%s'", stream_file);
+}
+
+static void mmio_callback(hwaddr_t addr, size_t len, bool is_write) { }
+static void pio_callback(ioaddr_t addr, size_t len, bool is_write) { }
+
+static void init() {
+	init_machine(HW_MEM_SIZE_DEFAULT);
+	init_ddr3();
+	init_regex();
+	init_vga_scale();
+
+	int i, j;
+	srand(0);
+	for(i = 0; i < NR_ADDR; i ++) {
+		/* away from the stream and the video memory */
+		seq_addr[i] = 0x800000 + i * 4;
+		rand_addr[i] = 0x1000000 + ((rand() % ((hw_mem_size - 0x1000000) >> 2)) << 2);
+	}
+
+	add_mmio_map(0xd0000, 0x1000, mmio_callback);
+	add_pio_map(0x3f8, 8, pio_callback);
+
+	for(i = 0; i < 256; i ++) { pal[i] = rand(); }
+	for(i = 0; i < CTR_ROW; i ++) {
+		for(j = 0; j < CTR_COL; j ++) { frame[i][j] = rand(); }
+	}
+
+	if(stream_file != NULL) {
+		record_stream();
+	}
+}
+
+
+/* the benchmarks, each runs `n' operations */
+
+static void bench_exec(int n) {
+	int i = stream_len;
+	while(n --) {
+		if(i == stream_len) {
+			cpu = stream_cpu;
+			i = 0;
+		}
+		exec(stream[i ++]);
+	}
+}
+
+static void bench_ifetch(int n) {
+	int i = 0;
+	uint32_t s = 0;
+	while(n --) {
+		s += instr_fetch(stream[i], 2);
+		if(++ i == stream_len) { i = 0; }
+	}
+	sink = s;
+}
+
+#define make_read_bench(name, fun, addr) \
+	static void name(int n) { \
+		uint32_t s = 0; \
+		while(n --) { s += fun(addr[n & (NR_ADDR - 1)], 4); } \
+		sink = s; \
+	}
+
+#define make_write_bench(name, fun, addr) \
+	static void name(int n) { \
+		while(n --) { fun(addr[n & (NR_ADDR - 1)], 4, n); } \
+	}
+
+make_read_bench(bench_dram_read_seq, dram_read, seq_addr)
+make_read_bench(bench_dram_read_rand, dram_read, rand_addr)
+make_write_bench(bench_dram_write_seq, dram_write, seq_addr)
+make_write_bench(bench_dram_write_rand, dram_write, rand_addr)
+make_read_bench(bench_swaddr_read_seq, swaddr_read, seq_addr)
+make_read_bench(bench_swaddr_read_rand, swaddr_read, rand_addr)
+make_write_bench(bench_swaddr_write_seq, swaddr_write, seq_addr)
+make_write_bench(bench_swaddr_write_rand, swaddr_write, rand_addr)
+
+static void bench_mmio_read(int n) {
+	uint32_t s = 0;
+	while(n --) {
+		hwaddr_t addr = 0xd0000 + (n & 0xffc);
+		s += mmio_read(addr, 4, is_mmio(addr));
+	}
+	sink = s;
+}
+
+static void bench_mmio_write(int n) {
+	while(n --) {
+		hwaddr_t addr = 0xd0000 + (n & 0xffc);
+		mmio_write(addr, 4, n, is_mmio(addr));
+	}
+}
+
+static void bench_pio_read(int n) {
+	uint32_t s = 0;
+	while(n --) { s += pio_read(0x3f8 + (n & 7), 1); }
+	sink = s;
+}
+
+static void bench_pio_write(int n) {
+	while(n --) { pio_write(0x3f8 + (n & 7), 1, n); }
+}
+
+static char *exprs[] = {
+	"1 + 2 * (3 - 4) / 5",
+	"0x100000 + $eax * 4 == $ebx || !$ecx",
+	"*0x100000 != 0 && *(0x100000 + 4 * 2) <= 0x7fffffff",
+};
+
+static void bench_expr(int n) {
+	bool success;
+	uint32_t s = 0;
+	while(n --) {
+		s += expr(exprs[n % (sizeof(exprs) / sizeof(exprs[0]))], &success);
+		assert(success);
+	}
+	sink = s;
+}
+
+/* a guest drawing a whole frame into the video memory */
+static void bench_vga_draw(int n) {
+	int i;
+	while(n --) {
+		for(i = 0; i < CTR_ROW * CTR_COL; i += 4) {
+			hwaddr_write(VMEM_ADDR + i, 4, *(uint32_t *)((uint8_t *)frame + i));
+		}
+		memset(vmem_dirty_map, 0, sizeof(vmem_dirty_map));
+		vmem_dirty = false;
+	}
+}
+
+/* the conversion of a whole frame to the host pixels */
+static void bench_vga_expand(int n) {
+	int i;
+	while(n --) {
+		for(i = 0; i < CTR_ROW; i ++) {
+			vga_expand_line(screen[2 * i], screen[2 * i + 1], frame[i], pal, CTR_COL);
+		}
+	}
+}
+
+static struct {
+	char *name;
+	char *unit;
+	void (*run) (int);
+	bool need_stream;
+} bench_table [] = {
+	{ "exec", "instr", bench_exec, true },
+	{ "ifetch", "fetch", bench_ifetch, true },
+	{ "dram_read/seq", "op", bench_dram_read_seq },
+	{ "dram_read/rand", "op", bench_dram_read_rand },
+	{ "dram_write/seq", "op", bench_dram_write_seq },
+	{ "dram_write/rand", "op", bench_dram_write_rand },
+	{ "swaddr_read/seq", "op", bench_swaddr_read_seq },
+	{ "swaddr_read/rand", "op", bench_swaddr_read_rand },
+	{ "swaddr_write/seq", "op", bench_swaddr_write_seq },
+	{ "swaddr_write/rand", "op", bench_swaddr_write_rand },
+	{ "mmio_read", "op", bench_mmio_read },
+	{ "mmio_write", "op", bench_mmio_write },
+	{ "pio_read", "op", bench_pio_read },
+	{ "pio_write", "op", bench_pio_write },
+	{ "expr", "expr", bench_expr },
+	{ "vga_draw", "frame", bench_vga_draw },
+	{ "vga_expand", "frame", bench_vga_expand },
+};
+
+#define NR_BENCH (sizeof(bench_table) / sizeof(bench_table[0]))
+
+static int cmp_double(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static void run_bench(int i) {
+	/* the batch of a sample takes at least SAMPLE_NS */
+	int batch = 1;
+	while(1) {
+		uint64_t start = now_ns();
+		bench_table[i].run(batch);
+		if(now_ns() - start >= SAMPLE_NS || batch >= (1 << 24)) { break; }
+		batch <<= 1;
+	}
+
+	double *t = malloc(sizeof(double) * nr_sample);
+	assert(t);
+	double sum = 0;
+	int k;
+	for(k = 0; k < nr_sample; k ++) {
+		uint64_t start = now_ns();
+		bench_table[i].run(batch);
+		t[k] = (double)(now_ns() - start) / batch;
+		sum += t[k];
+	}
+	qsort(t, nr_sample, sizeof(double), cmp_double);
+
+	/* the nearest rank, P(0) is the minimum */
+#define RANK(p) ((nr_sample * p + 99) / 100 - 1)
+#define P(p) t[RANK(p) > 0 ? RANK(p) : 0]
+	printf("%-18s %12.1f %10.1f %10.1f %10.1f %10.1f  ns/%s\n", bench_table[i].name,
+			sum / nr_sample, P(0), P(50), P(90), P(99), bench_table[i].unit);
+#undef P
+#undef RANK
+	free(t);
+}
+
+static bool selected(int i, int argc, char *argv[]) {
+	if(argc == 0) { return true; }
+	int k;
+	for(k = 0; k < argc; k ++) {
+		if(strncmp(bench_table[i].name, argv[k], strlen(argv[k])) == 0) { return true; }
+	}
+	return false;
+}
+
+int main(int argc, char *argv[]) {
+	int o;
+	while((o = getopt(argc, argv, "n:s:")) != -1) {
+		switch(o) {
+			case 'n': nr_sample = atoi(optarg); break;
+			case 's': stream_file = optarg; break;
+			default:
+				printf("Usage: %s [-n SAMPLES] [-s STREAM] [NAME...]\n", argv[0]);
+				return 1;
+		}
+	}
+	Assert(nr_sample > 0, "the number of samples must be positive");
+
+	init();
+	if(stream_file != NULL) {
+		printf("%d instructions recorded from %s\n", stream_len, stream_file);
+	}
+	printf("%-18s %12s %10s %10s %10s %10s\n", "benchmark", "mean", "min", "p50", "p90", "p99");
+
+	int i;
+	for(i = 0; i < NR_BENCH; i ++) {
+		if(!selected(i, argc - optind, argv + optind)) { continue; }
+		if(bench_table[i].need_stream && stream_file == NULL) {
+			printf("%-18s skipped, no stream (-s)\n", bench_table[i].name);
+			continue;
+		}
+		run_bench(i);
+	}
+
+	return 0;
+}
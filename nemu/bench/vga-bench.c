@@ -0,0 +1,61 @@
+#include "common.h"
+#include "device/vga-scale.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+/* Measure the frames per second of a full-screen refresh (320x200 8-bit
+ * indexed pixels to 640x400 32-bit pixels) with each conversion kernel.
+ */
+
+#define CTR_ROW 200
+#define CTR_COL 320
+#define NR_FRAME 2000
+
+static uint8_t vmem[CTR_ROW][CTR_COL];
+static uint32_t screen[2 * CTR_ROW][2 * CTR_COL];
+static uint32_t pal[256];
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench(const char *name, vga_expand_line_t expand_line) {
+	int i, f;
+	double start = now();
+	for(f = 0; f < NR_FRAME; f ++) {
+		for(i = 0; i < CTR_ROW; i ++) {
+			expand_line(screen[2 * i], screen[2 * i + 1], vmem[i], pal, CTR_COL);
+		}
+	}
+	double t = now() - start;
+
+	/* check against the scalar kernel */
+	static uint32_t ref[2 * CTR_ROW][2 * CTR_COL];
+	for(i = 0; i < CTR_ROW; i ++) {
+		vga_expand_line_scalar(ref[2 * i], ref[2 * i + 1], vmem[i], pal, CTR_COL);
+	}
+	Assert(memcmp(ref, screen, sizeof(ref)) == 0, "%s: wrong result", name);
+
+	printf("%-8s %10.1f fps %8.3f ms/frame\n", name, NR_FRAME / t, t * 1e3 / NR_FRAME);
+}
+
+int main() {
+	int i, j;
+	srand(0);
+	for(i = 0; i < 256; i ++) { pal[i] = rand(); }
+	for(i = 0; i < CTR_ROW; i ++) {
+		for(j = 0; j < CTR_COL; j ++) { vmem[i][j] = rand(); }
+	}
+
+	bench("scalar", vga_expand_line_scalar);
+#ifdef __SSE2__
+	bench("sse2", vga_expand_line_sse2);
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+	if(vga_scale_has_avx2()) { bench("avx2", vga_expand_line_avx2); }
+#endif
+	return 0;
+}
@@ -0,0 +1,49 @@
+#include "libnemu.h"
+
+#include <stdio.h>
+#include <dlfcn.h>
+
+/* Load libnemu.so at runtime, as a host program (or Python ctypes) does,
+ * and run a program to its trap:
+ *   dlopen-libnemu LIBNEMU.so PROGRAM
+ * The library is not linked, so a library which can not be loaded by
+ * dlopen() (e.g. for its thread-local storage) is caught here.
+ */
+
+#define load(name) \
+	typeof(name) *p_##name = dlsym(lib, #name); \
+	if(p_##name == NULL) { \
+		printf("%s: %s\n", #name, dlerror()); \
+		return 1; \
+	}
+
+int main(int argc, char *argv[]) {
+	if(argc != 3) {
+		printf("Usage: %s LIBNEMU.so PROGRAM\n", argv[0]);
+		return 1;
+	}
+
+	void *lib = dlopen(argv[1], RTLD_NOW);
+	if(lib == NULL) {
+		printf("%s\n", dlerror());
+		return 1;
+	}
+
+	load(nemu_create);
+	load(nemu_run);
+	load(nemu_get_stats);
+	load(nemu_destroy);
+
+	nemu_machine *m = p_nemu_create(argv[2], 0, NEMU_ELF_BOOT);
+	int ret = p_nemu_run(m, NEMU_RUN_TO_END);
+	nemu_stats s;
+	p_nemu_get_stats(m, &s);
+	p_nemu_destroy(m);
+
+	if(ret != NEMU_ENDED || s.exit_code != 0) {
+		printf("%s did not hit the good trap in %s\n", argv[2], argv[1]);
+		return 1;
+	}
+	printf("%s: %s ran %llu instructions\n", argv[1], argv[2], (unsigned long long)s.instructions);
+	return 0;
+}
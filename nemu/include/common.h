@@ -23,6 +23,19 @@ typedef uint32_t swaddr_t;
 
 typedef uint16_t ioaddr_t;
 
+/* The state of a machine is thread-local, so that several guests can
+ * run in one process, each on its own host thread (see init_machine()).
+ * Read-only data, such as the symbol table and the opcode tables, is
+ * shared. The device models own host resources (the window, the timer
+ * signal, the serial sink), so a process with devices runs one guest.
+ */
+#ifdef __PIC__
+/* libnemu.so may be loaded with dlopen(), which needs the dynamic model */
+#define machine_local __thread
+#else
+#define machine_local __thread __attribute__((tls_model("initial-exec")))
+#endif
+
 #pragma pack (1)
 typedef union {
 	uint32_t _4;
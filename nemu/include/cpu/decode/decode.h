@@ -18,6 +18,9 @@ make_helper(decode_si_l);
 make_helper(decode_i2rm_b);
 make_helper(decode_i2rm_w);
 make_helper(decode_i2rm_l);
+make_helper(decode_i2rm_wo_b);
+make_helper(decode_i2rm_wo_w);
+make_helper(decode_i2rm_wo_l);
 make_helper(decode_i2a_b);
 make_helper(decode_i2a_w);
 make_helper(decode_i2a_l);
@@ -33,6 +36,9 @@ make_helper(decode_i_rm2r_l);
 make_helper(decode_r2rm_b);
 make_helper(decode_r2rm_w);
 make_helper(decode_r2rm_l);
+make_helper(decode_r2rm_wo_b);
+make_helper(decode_r2rm_wo_w);
+make_helper(decode_r2rm_wo_l);
 make_helper(decode_rm2r_b);
 make_helper(decode_rm2r_w);
 make_helper(decode_rm2r_l);
@@ -3,11 +3,17 @@
 
 enum { OP_TYPE_REG, OP_TYPE_MEM, OP_TYPE_IMM };
 
+/* How an instruction accesses a r/m operand. A memory operand is only
+ * loaded when the instruction reads it, so write-only destinations
+ * do not issue a memory read (nor trigger MMIO read callbacks). */
+enum { OP_ACCESS_R = 0x1, OP_ACCESS_W = 0x2, OP_ACCESS_RW = 0x3 };
+
 #define OP_STR_SIZE 40
 
 typedef struct {
 	uint32_t type;
 	size_t size;
+	uint32_t access;
 	union {
 		uint32_t reg;
 		swaddr_t addr;
@@ -16,7 +16,13 @@
 		return idex(eip, concat4(decode_, type, _, SUFFIX), do_execute); \
 	}
 
-extern char assembly[];
+/* for instructions whose r/m destination is write-only */
+#define make_instr_helper_wo(type) \
+	make_helper(concat5(instr, _, type, _, SUFFIX)) { \
+		return idex(eip, concat4(decode_, type, _wo_, SUFFIX), do_execute); \
+	}
+
+extern machine_local char assembly[];
 #ifdef DEBUG
 #define print_asm(...) Assert(snprintf(assembly, 80, __VA_ARGS__) < 80, "buffer overflow!")
 #else
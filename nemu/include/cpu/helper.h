@@ -3,14 +3,11 @@
 
 #include "nemu.h"
 #include "cpu/decode/operand.h"
+#include "cpu/ifetch.h"
 
 /* All function defined with 'make_helper' return the length of the operation. */
 #define make_helper(name) int name(swaddr_t eip)
 
-static inline uint32_t instr_fetch(swaddr_t addr, size_t len) {
-	return swaddr_read(addr, len);
-}
-
 /* Instruction Decode and EXecute */
 static inline int idex(swaddr_t eip, int (*decode)(swaddr_t), void (*execute) (void)) {
 	/* eip is pointing to the opcode */
@@ -20,7 +17,7 @@ static inline int idex(swaddr_t eip, int (*decode)(swaddr_t), void (*execute) (v
 }
 
 /* shared by all helper function */
-extern Operands ops_decoded;
+extern machine_local Operands ops_decoded;
 
 #define op_src (&ops_decoded.src)
 #define op_src2 (&ops_decoded.src2)
@@ -0,0 +1,52 @@
+#ifndef __IFETCH_H__
+#define __IFETCH_H__
+
+#include "common.h"
+
+/* Instruction prefetch buffer.
+ * The decoders fetch the opcode, ModR/M, SIB, displacement and immediate
+ * with several calls of instr_fetch(). Instead of sending each of them
+ * through the whole memory stack, we keep an aligned line of the
+ * instruction stream here, and only refill it when a fetch crosses the
+ * line boundary. A line never crosses a page boundary.
+ */
+
+#define IFB_WIDTH 4
+#define IFB_LEN (1 << IFB_WIDTH)
+#define IFB_MASK (IFB_LEN - 1)
+
+typedef struct {
+	uint8_t buf[IFB_LEN + 3];	/* "+ 3" is for unaligned 4-byte reads at the end */
+	swaddr_t tag;
+	bool valid;
+
+	/* statistics */
+	uint64_t nr_fetch;		/* number of calls to instr_fetch() */
+	uint64_t nr_bus_read;	/* number of memory reads issued to fill the buffer */
+} IFB;
+
+extern machine_local IFB ifb;
+
+uint32_t instr_fetch_slow(swaddr_t, size_t);
+void ifb_flush();
+
+static inline uint32_t instr_fetch(swaddr_t addr, size_t len) {
+	uint32_t offset = addr & IFB_MASK;
+	ifb.nr_fetch ++;
+	if(ifb.valid && (addr & ~IFB_MASK) == ifb.tag && offset + len <= IFB_LEN) {
+		return unalign_rw(ifb.buf + offset, 4) & (~0u >> ((4 - len) << 3));
+	}
+	return instr_fetch_slow(addr, len);
+}
+
+/* Called by the memory stack on every store, so that the buffer never
+ * holds stale bytes (e.g. code written by the loader or self-modifying code).
+ */
+static inline void ifb_check_write(swaddr_t addr, size_t len) {
+	if(ifb.valid && (((addr & ~IFB_MASK) == ifb.tag) ||
+				(((addr + len - 1) & ~IFB_MASK) == ifb.tag))) {
+		ifb.valid = false;
+	}
+}
+
+#endif
@@ -33,7 +33,7 @@ typedef struct {
 
 } CPU_state;
 
-extern CPU_state cpu;
+extern machine_local CPU_state cpu;
 
 static inline int check_reg_index(int index) {
 	assert(index >= 0 && index < 8);
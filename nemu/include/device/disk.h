@@ -0,0 +1,16 @@
+#ifndef __DISK_H__
+#define __DISK_H__
+
+#include "common.h"
+
+void init_disk(const char *, const char *);
+size_t disk_size();
+void disk_read(void *, uint32_t, size_t);
+void disk_write(const void *, uint32_t, size_t);
+void disk_commit();
+void disk_discard();
+void disk_info();
+void disk_save();
+void disk_load();
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef __EVENT_H__
+#define __EVENT_H__
+
+#include "common.h"
+
+/* Device event queue.
+ * Devices schedule callbacks at a point of the virtual time, which is
+ * measured by the number of instructions retired (`nr_instr').
+ */
+
+typedef void (*event_callback_t)(void *);
+
+extern machine_local uint64_t nr_instr;
+extern machine_local uint64_t next_event_time;
+
+void init_event();
+void add_event(uint64_t, event_callback_t, void *);
+void handle_events();
+void *event_save();
+void event_load(const void *);
+
+/* called by the CPU after each instruction */
+static inline void event_update() {
+	if(nr_instr >= next_event_time) {
+		handle_events();
+	}
+}
+
+#endif
@@ -5,6 +5,7 @@
 
 typedef void(*pio_callback_t)(ioaddr_t, size_t, bool);
 
+void init_port_io();
 void* add_pio_map(ioaddr_t, size_t, pio_callback_t);
 
 uint32_t pio_read(ioaddr_t, size_t);
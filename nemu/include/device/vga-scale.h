@@ -0,0 +1,26 @@
+#ifndef __VGA_SCALE_H__
+#define __VGA_SCALE_H__
+
+#include "common.h"
+
+/* Expand `n' 8-bit indexed pixels of `src' through the palette `pal',
+ * and write them 2x2-scaled to the screen rows `dst0' and `dst1'.
+ */
+typedef void (*vga_expand_line_t)(uint32_t *dst0, uint32_t *dst1,
+		const uint8_t *src, const uint32_t *pal, int n);
+
+/* the best implementation for the host, chosen by init_vga_scale() */
+extern vga_expand_line_t vga_expand_line;
+
+void init_vga_scale();
+
+void vga_expand_line_scalar(uint32_t *, uint32_t *, const uint8_t *, const uint32_t *, int);
+#ifdef __SSE2__
+void vga_expand_line_sse2(uint32_t *, uint32_t *, const uint8_t *, const uint32_t *, int);
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+void vga_expand_line_avx2(uint32_t *, uint32_t *, const uint8_t *, const uint32_t *, int);
+bool vga_scale_has_avx2();
+#endif
+
+#endif
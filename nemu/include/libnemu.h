@@ -0,0 +1,59 @@
+#ifndef __LIBNEMU_H__
+#define __LIBNEMU_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* The C API of libnemu (make libnemu).
+ * The state of a machine is thread-local (see common.h), so a machine
+ * belongs to the thread which creates it, and every call on it must be
+ * made from that thread. Several threads can each run their own machine.
+ * Errors in the guest (an invalid opcode, an access out of the memory)
+ * abort the process, as they do in NEMU.
+ */
+
+typedef struct nemu_machine nemu_machine;
+
+/* flags of nemu_create() */
+#define NEMU_ELF_BOOT 0x1	/* load the segments and start from the entry, see --elf */
+
+/* results of nemu_run() */
+enum { NEMU_STOPPED, NEMU_ENDED };
+
+/* nemu_get_reg() and nemu_set_reg() take the i386 register numbers */
+enum { NEMU_EAX, NEMU_ECX, NEMU_EDX, NEMU_EBX, NEMU_ESP, NEMU_EBP, NEMU_ESI, NEMU_EDI, NEMU_EIP };
+
+#define NEMU_RUN_TO_END (~0ull)
+
+typedef struct {
+	uint64_t instructions;
+	uint64_t instr_fetches, bus_reads;
+	double run_time;		/* seconds spent in nemu_run() */
+	int ended;
+	uint32_t exit_code;		/* eax at the trap, 0 for HIT GOOD TRAP */
+} nemu_stats;
+
+/* `image' is the ELF program. Without NEMU_ELF_BOOT, the program is
+ * started by `entry' in the working directory, as in NEMU.
+ * `mem_mb' is the size of the physical memory, 0 for the default.
+ */
+nemu_machine *nemu_create(const char *image, uint32_t mem_mb, int flags);
+void nemu_destroy(nemu_machine *);
+
+/* Run `n' instructions, or until the trap or a breakpoint. */
+int nemu_run(nemu_machine *, uint64_t n);
+
+uint32_t nemu_get_reg(nemu_machine *, int reg);
+void nemu_set_reg(nemu_machine *, int reg, uint32_t val);
+
+/* physical memory */
+void nemu_read_mem(nemu_machine *, uint32_t addr, void *buf, size_t len);
+void nemu_write_mem(nemu_machine *, uint32_t addr, const void *buf, size_t len);
+
+/* save-states, see --load-state */
+int nemu_save(nemu_machine *, const char *path);
+void nemu_load(nemu_machine *, const char *path);
+
+void nemu_get_stats(nemu_machine *, nemu_stats *);
+
+#endif
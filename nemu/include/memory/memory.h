@@ -3,9 +3,14 @@
 
 #include "common.h"
 
-#define HW_MEM_SIZE (128 * 1024 * 1024)
+/* The size of physical memory can be set with `--mem' on the command line. */
+#define HW_MEM_SIZE_DEFAULT (128 * 1024 * 1024)
+/* start.S of the testcases and the kernel set the stack at 128 MB */
+#define MIN_BOOT_MEM_SIZE (128 * 1024 * 1024)
+#define HW_MEM_SIZE hw_mem_size
 
-extern uint8_t *hw_mem;
+extern machine_local uint8_t *hw_mem;
+extern machine_local uint32_t hw_mem_size;
 
 /* convert the hardware address in the test program to virtual address in NEMU */
 #define hwa_to_va(p) ((void *)(hw_mem + (unsigned)p))
@@ -0,0 +1,45 @@
+#ifndef __VMEM_DIRTY_H__
+#define __VMEM_DIRTY_H__
+
+#include "common.h"
+
+/* Dirty tracking of the video memory.
+ * The VGA window [0xa0000, 0xc0000) is ordinary physical memory. Instead
+ * of calling back into the VGA device on every store, the memory stack
+ * marks the 32-byte chunks being written in a bitmap, and the renderer
+ * takes and clears it at the next refresh. A mode 13h line is exactly
+ * 10 chunks.
+ */
+
+#define VMEM_ADDR 0xa0000
+#define VMEM_SIZE 0x20000
+
+#define VMEM_CHUNK_WIDTH 5
+#define VMEM_CHUNK_SIZE (1 << VMEM_CHUNK_WIDTH)
+#define VMEM_NR_CHUNK (VMEM_SIZE >> VMEM_CHUNK_WIDTH)
+
+extern machine_local uint32_t vmem_dirty_map[VMEM_NR_CHUNK / 32];
+extern machine_local bool vmem_dirty;
+
+static inline void vmem_set_dirty(uint32_t chunk) {
+	vmem_dirty_map[chunk >> 5] |= 1u << (chunk & 31);
+}
+
+static inline bool vmem_is_dirty(uint32_t chunk) {
+	return (vmem_dirty_map[chunk >> 5] >> (chunk & 31)) & 1;
+}
+
+/* Called on every store to the physical memory. */
+static inline void vmem_check_write(hwaddr_t addr, size_t len) {
+	if(addr - VMEM_ADDR < VMEM_SIZE) {
+		uint32_t first = (addr - VMEM_ADDR) >> VMEM_CHUNK_WIDTH;
+		uint32_t last = (addr + len - 1 - VMEM_ADDR) >> VMEM_CHUNK_WIDTH;
+		if(last >= VMEM_NR_CHUNK) { last = VMEM_NR_CHUNK - 1; }
+		for(; first <= last; first ++) {
+			vmem_set_dirty(first);
+		}
+		vmem_dirty = true;
+	}
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include "common.h"
+
+/* Checkpoints for reverse execution.
+ * Every `checkpoint_interval' instructions the CPU and the devices are
+ * saved. Memory is not copied at that time: the first store to a page
+ * after a checkpoint saves the old content of the page in the undo log
+ * of the checkpoint. Going back applies the undo logs from the latest
+ * one, and re-executes from the checkpoint to the wanted instruction.
+ */
+
+#define CKPT_PAGE_WIDTH 12
+#define CKPT_PAGE_SIZE (1 << CKPT_PAGE_WIDTH)
+
+extern machine_local uint32_t hw_mem_size;
+extern machine_local uint64_t nr_instr;
+extern machine_local uint64_t next_checkpoint;
+
+/* pages already in the undo log of the latest checkpoint, NULL if off */
+extern machine_local uint32_t *ckpt_page_saved;
+
+void checkpoint_take();
+void checkpoint_save_page(uint32_t);
+
+void init_checkpoint();
+void reverse_step(uint64_t);
+void reverse_continue();
+
+/* Called on every store to the physical memory, before the data is written. */
+static inline void checkpoint_check_write(hwaddr_t addr, size_t len) {
+	if(ckpt_page_saved != NULL) {
+		/* the pages out of the memory are left to the DRAM to complain */
+		uint32_t nr_page = hw_mem_size >> CKPT_PAGE_WIDTH;
+		uint32_t first = addr >> CKPT_PAGE_WIDTH;
+		uint32_t last = (addr + len - 1) >> CKPT_PAGE_WIDTH;
+		if(last >= nr_page) { last = nr_page - 1; }
+		for(; first <= last; first ++) {
+			if(!((ckpt_page_saved[first >> 5] >> (first & 31)) & 1)) {
+				checkpoint_save_page(first);
+			}
+		}
+	}
+}
+
+/* called by the CPU after each instruction */
+static inline void checkpoint_update() {
+	if(nr_instr >= next_checkpoint) {
+		checkpoint_take();
+	}
+}
+
+#endif
@@ -1,7 +1,9 @@
 #ifndef __MONITOR_H__
 #define __MONITOR_H__
 
+#include "common.h"
+
 enum { STOP, RUNNING, END };
-extern int nemu_state;
+extern machine_local int nemu_state;
 
 #endif
@@ -0,0 +1,42 @@
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+
+#include "common.h"
+
+/* Record and replay of the asynchronous inputs.
+ * The timer signal, the screen refresh and the keys of the SDL window
+ * arrive at host times. They enter the machine only through
+ * device_input(), after an instruction, and a recording keeps each of
+ * them with the number of instructions retired at that point. Replaying
+ * ignores the live inputs and feeds the recorded ones after the same
+ * instructions, so the run is the same as the recorded one.
+ *
+ * A recording starts with a header and the initial CPU state, whose
+ * registers are random. Then each input is a LEB128 number,
+ * (instructions since the previous input << 2 | type), followed by the
+ * scancode for INPUT_KEY.
+ */
+
+#define REPLAY_MAGIC "NEMUREC"
+#define REPLAY_VERSION 1
+
+enum { INPUT_TIMER, INPUT_SCREEN, INPUT_KEY, INPUT_QUIT };
+
+enum { REPLAY_OFF, REPLAY_RECORD, REPLAY_PLAY };
+extern int replay_mode;
+
+extern machine_local uint64_t nr_instr;
+extern uint64_t next_input_time;
+
+void init_replay();
+void record_input(int, uint8_t);
+void replay_inputs();
+
+/* called instead of taking the live inputs when replaying */
+static inline void replay_update() {
+	if(nr_instr >= next_input_time) {
+		replay_inputs();
+	}
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef __SAVESTATE_H__
+#define __SAVESTATE_H__
+
+#include "common.h"
+
+/* Save-state file.
+ * A header followed by tagged sections, each aligned to 8 bytes:
+ *
+ *   +-------------------------+-----------------------------+-----+
+ *   | "NEMUSAVE", version     | tag, size | data (padded)   | ... | "END "
+ *   +-------------------------+-----------------------------+-----+
+ *
+ * "CPU " is CPU_state and the instruction count, "RAM " is the physical
+ * memory with zero pages left out and the others run-length encoded,
+ * and each device saves its own sections. The file is loaded by
+ * mapping it, so a section is used in place.
+ */
+
+#define SAVESTATE_MAGIC "NEMUSAVE"
+#define SAVESTATE_VERSION 1
+
+/* Used by the devices to save and load their state. */
+void savestate_put(const char *tag, const void *data, size_t len);
+const void *savestate_get(const char *tag, size_t *len);
+void savestate_get_copy(const char *tag, void *data, size_t len);
+
+bool save_state(const char *);
+void load_state(const char *);
+
+/* set while the devices are saved for a checkpoint, see monitor/checkpoint.h */
+extern machine_local bool savestate_in_memory;
+void *save_devices_mem(size_t *);
+void load_devices_mem(void *, size_t);
+
+#endif
@@ -19,4 +19,6 @@ void free_wp(WP *wp);
 bool check_wp();
 WP *find_wp(int);
 void print_wp();
+void wp_enable(bool);
+void wp_resync();
 #endif
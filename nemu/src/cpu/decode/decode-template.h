@@ -67,8 +67,9 @@ static int concat3(decode_r_, SUFFIX, _internal) (swaddr_t eip, Operand *op) {
 	return 0;
 }
 
-static int concat3(decode_rm_, SUFFIX, _internal) (swaddr_t eip, Operand *rm, Operand *reg) {
+static int concat3(decode_rm_, SUFFIX, _internal) (swaddr_t eip, Operand *rm, Operand *reg, uint32_t access) {
 	rm->size = DATA_BYTE;
+	rm->access = access;
 	int len = read_ModR_M(eip, rm, reg);
 	reg->val = REG(reg->reg);
 
@@ -82,14 +83,19 @@ static int concat3(decode_rm_, SUFFIX, _internal) (swaddr_t eip, Operand *rm, Op
  * Ev <- Gv
  */
 make_helper(concat(decode_r2rm_, SUFFIX)) {
-	return decode_rm_internal(eip, op_dest, op_src);
+	return decode_rm_internal(eip, op_dest, op_src, OP_ACCESS_RW);
+}
+
+/* same as above, but Eb/Ev is write-only (e.g. mov) */
+make_helper(concat(decode_r2rm_wo_, SUFFIX)) {
+	return decode_rm_internal(eip, op_dest, op_src, OP_ACCESS_W);
 }
 
 /* Gb <- Eb
  * Gv <- Ev
  */
 make_helper(concat(decode_rm2r_, SUFFIX)) {
-	return decode_rm_internal(eip, op_src, op_dest);
+	return decode_rm_internal(eip, op_src, op_dest, OP_ACCESS_R);
 }
 
 
@@ -105,7 +111,7 @@ make_helper(concat(decode_i2a_, SUFFIX)) {
  * Gv <- EvIv
  * use for imul */
 make_helper(concat(decode_i_rm2r_, SUFFIX)) {
-	int len = decode_rm_internal(eip, op_src2, op_dest);
+	int len = decode_rm_internal(eip, op_src2, op_dest, OP_ACCESS_R);
 	len += decode_i(eip + len);
 	return len;
 }
@@ -114,7 +120,14 @@ make_helper(concat(decode_i_rm2r_, SUFFIX)) {
  * Ev <- Iv
  */
 make_helper(concat(decode_i2rm_, SUFFIX)) {
-	int len = decode_rm_internal(eip, op_dest, op_src2);		/* op_src2 not use here */
+	int len = decode_rm_internal(eip, op_dest, op_src2, OP_ACCESS_RW);		/* op_src2 not use here */
+	len += decode_i(eip + len);
+	return len;
+}
+
+/* same as above, but Eb/Ev is write-only (e.g. mov) */
+make_helper(concat(decode_i2rm_wo_, SUFFIX)) {
+	int len = decode_rm_internal(eip, op_dest, op_src2, OP_ACCESS_W);	/* op_src2 not use here */
 	len += decode_i(eip + len);
 	return len;
 }
@@ -129,7 +142,7 @@ make_helper(concat(decode_i2r_, SUFFIX)) {
 
 /* used by unary operations */
 make_helper(concat(decode_rm_, SUFFIX)) {
-	return decode_rm_internal(eip, op_src, op_src2);		/* op_src2 not use here */
+	return decode_rm_internal(eip, op_src, op_src2, OP_ACCESS_RW);		/* op_src2 not use here */
 }
 
 make_helper(concat(decode_r_, SUFFIX)) {
@@ -138,13 +151,13 @@ make_helper(concat(decode_r_, SUFFIX)) {
 
 #if DATA_BYTE == 2 || DATA_BYTE == 4
 make_helper(concat(decode_si2rm_, SUFFIX)) {
-	int len = decode_rm_internal(eip, op_dest, op_src2);	/* op_src2 not use here */
+	int len = decode_rm_internal(eip, op_dest, op_src2, OP_ACCESS_RW);	/* op_src2 not use here */
 	len += decode_si_b(eip + len);
 	return len;
 }
 
 make_helper(concat(decode_si_rm2r_, SUFFIX)) {
-	int len = decode_rm_internal(eip, op_src2, op_dest);
+	int len = decode_rm_internal(eip, op_src2, op_dest, OP_ACCESS_R);
 	len += decode_si_b(eip + len);
 	return len;
 }
@@ -109,7 +109,9 @@ int read_ModR_M(swaddr_t eip, Operand *rm, Operand *reg) {
 	}
 	else {
 		int instr_len = load_addr(eip, &m, rm);
-		rm->val = swaddr_read(rm->addr, rm->size);
+		if(rm->access & OP_ACCESS_R) {
+			rm->val = swaddr_read(rm->addr, rm->size);
+		}
 		return instr_len;
 	}
 }
@@ -8,8 +8,8 @@ static void do_execute() {
 }
 
 make_instr_helper(i2r)
-make_instr_helper(i2rm)
-make_instr_helper(r2rm)
+make_instr_helper_wo(i2rm)
+make_instr_helper_wo(r2rm)
 make_instr_helper(rm2r)
 
 make_helper(concat(mov_a2moffs_, SUFFIX)) {
@@ -0,0 +1,59 @@
+/* Declarative specification of the opcode map.
+ *
+ * This file is expanded several times by exec.c (X-macro) to declare the
+ * helpers and to generate the dispatch tables, one for each operand size.
+ * Do not include it anywhere else.
+ *
+ *   INSTR_B(opcode, helper)       the same helper for both operand sizes
+ *   INSTR_V(opcode, helper)       `helper_w' for 16-bit operand size,
+ *                                 `helper_l' for 32-bit operand size
+ *   GROUP_B(opcode, reg, helper)  group instruction, selected by the
+ *   GROUP_V(opcode, reg, helper)  reg field of the ModR/M byte
+ *
+ * Two-byte opcodes (0x0f xx) are written as 0x1xx, which is also the value
+ * of `ops_decoded.opcode' when they are executed. Unlisted slots are `inv'.
+ *
+ * Groups used by i386:
+ *   0x80 group1_b, 0x81 group1_v, 0x83 group1_sx_v,
+ *   0xc0 group2_i_b, 0xc1 group2_i_v, 0xd0 group2_1_b, 0xd1 group2_1_v,
+ *   0xd2 group2_cl_b, 0xd3 group2_cl_v, 0xf6 group3_b, 0xf7 group3_v,
+ *   0xfe group4, 0xff group5, 0x100 group6, 0x101 group7
+ * e.g. "shl Ev, 1" is `GROUP_V(0xd1, 4, shl_rm_1)'.
+ */
+
+/* TODO: Add more instructions!!! */
+
+/* prefix */
+INSTR_B(0x66, operand_size)
+
+/* data movement */
+INSTR_B(0x88, mov_r2rm_b)
+INSTR_V(0x89, mov_r2rm)
+INSTR_B(0x8a, mov_rm2r_b)
+INSTR_V(0x8b, mov_rm2r)
+INSTR_B(0xa0, mov_moffs2a_b)
+INSTR_V(0xa1, mov_moffs2a)
+INSTR_B(0xa2, mov_a2moffs_b)
+INSTR_V(0xa3, mov_a2moffs)
+INSTR_B(0xb0, mov_i2r_b)
+INSTR_B(0xb1, mov_i2r_b)
+INSTR_B(0xb2, mov_i2r_b)
+INSTR_B(0xb3, mov_i2r_b)
+INSTR_B(0xb4, mov_i2r_b)
+INSTR_B(0xb5, mov_i2r_b)
+INSTR_B(0xb6, mov_i2r_b)
+INSTR_B(0xb7, mov_i2r_b)
+INSTR_V(0xb8, mov_i2r)
+INSTR_V(0xb9, mov_i2r)
+INSTR_V(0xba, mov_i2r)
+INSTR_V(0xbb, mov_i2r)
+INSTR_V(0xbc, mov_i2r)
+INSTR_V(0xbd, mov_i2r)
+INSTR_V(0xbe, mov_i2r)
+INSTR_V(0xbf, mov_i2r)
+INSTR_B(0xc6, mov_i2rm_b)
+INSTR_V(0xc7, mov_i2rm)
+
+/* special */
+INSTR_B(0xcc, int3)
+INSTR_B(0xd6, nemu_trap)
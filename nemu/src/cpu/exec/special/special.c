@@ -32,6 +32,11 @@ make_helper(nemu_trap) {
 		   	break;
 
 		default:
+#ifdef HAS_DEVICE
+			/* the output of the program comes before the trap */
+			extern void serial_flush();
+			serial_flush();
+#endif
 			printf("\33[1;31mnemu: HIT %s TRAP\33[0m at eip = 0x%08x\n\n",
 					(cpu.eax == 0 ? "GOOD" : "BAD"), cpu.eip);
 			nemu_state = END;
@@ -0,0 +1,43 @@
+#include "nemu.h"
+#include "cpu/ifetch.h"
+
+machine_local IFB ifb;
+
+static void ifb_fill(swaddr_t tag) {
+	int i;
+	for(i = 0; i < IFB_LEN; i += 4) {
+		*(uint32_t *)(ifb.buf + i) = swaddr_read(tag + i, 4);
+		ifb.nr_bus_read ++;
+	}
+	ifb.tag = tag;
+	ifb.valid = true;
+}
+
+static inline uint32_t ifb_read(uint32_t offset, size_t len) {
+	return unalign_rw(ifb.buf + offset, 4) & (~0u >> ((4 - len) << 3));
+}
+
+uint32_t instr_fetch_slow(swaddr_t addr, size_t len) {
+	uint32_t offset = addr & IFB_MASK;
+	swaddr_t tag = addr & ~IFB_MASK;
+
+	if(!(ifb.valid && ifb.tag == tag)) {
+		ifb_fill(tag);
+	}
+
+	if(offset + len <= IFB_LEN) {
+		return ifb_read(offset, len);
+	}
+
+	/* The data crosses the line boundary. Read the low part from
+	 * this line, then refill the buffer with the next line. */
+	size_t lo_len = IFB_LEN - offset;
+	uint32_t data = ifb_read(offset, lo_len);
+	ifb_fill(tag + IFB_LEN);
+	data |= ifb_read(0, len - lo_len) << (lo_len << 3);
+	return data;
+}
+
+void ifb_flush() {
+	ifb.valid = false;
+}
@@ -1,18 +1,96 @@
 #include "common.h"
 #ifdef HAS_DEVICE
 
+#include "monitor/replay.h"
+
+#include <stdlib.h>
+
+void init_event();
 void init_serial();
 void init_timer();
 void init_vga();
 void init_i8042();
 void init_ide();
+void init_sdl();
+void init_capture();
+void init_key_script();
+
+extern const char *capture_file;
+extern const char *key_script;
 
 void init_device() {
+	init_event();
 	init_serial();
 	init_timer();
 	init_vga();
 	init_i8042();
 	init_ide();
+
+	if(key_script) { init_key_script(); }
+
+	/* the display: a window, or frames captured to a file */
+	if(capture_file) { init_capture(); }
+	else { init_sdl(); }
+}
+
+void timer_intr();
+void keyboard_intr(uint8_t);
+void update_screen();
+
+/* The asynchronous inputs, live or replayed, enter the machine here
+ * after an instruction (see monitor/replay.h).
+ */
+void device_input(int type, uint8_t data) {
+	record_input(type, data);
+	switch(type) {
+		case INPUT_TIMER: timer_intr(); break;
+		case INPUT_SCREEN: update_screen(); break;
+		case INPUT_KEY: keyboard_intr(data); break;
+		case INPUT_QUIT: exit(0);
+	}
+}
+
+void pio_save();
+void pio_load();
+void mmio_save();
+void mmio_load();
+void i8259_save();
+void i8259_load();
+void serial_save();
+void vga_save();
+void vga_load();
+void i8042_save();
+void i8042_load();
+void ide_save();
+void ide_load();
+bool ide_busy();
+
+/* Whether the devices can be saved now. */
+bool devices_quiescent() {
+	return !ide_busy();
+}
+
+/* The device state in the save-state (see monitor/savestate.c). The
+ * pending events are not saved: the periodic ones are set up again by
+ * init_device(), and the others are finished before saving.
+ */
+void save_devices() {
+	serial_save();
+	pio_save();
+	mmio_save();
+	i8259_save();
+	vga_save();
+	i8042_save();
+	ide_save();
+}
+
+void load_devices() {
+	pio_load();
+	mmio_load();
+	i8259_load();
+	vga_load();
+	i8042_load();
+	ide_load();
 }
 
 #endif
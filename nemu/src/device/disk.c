@@ -0,0 +1,287 @@
+#include "common.h"
+#include "device/disk.h"
+#include "monitor/savestate.h"
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Copy-on-write disk.
+ * The base image is opened read-only and mapped once, so that many
+ * instances of NEMU can share it. Writes of the guest go to a private
+ * sparse overlay, which is block-granular: the first write to a block
+ * copies the block up from the base image, and an allocation bitmap
+ * records which blocks live in the overlay.
+ *
+ * The overlay is anonymous memory by default. With `--disk-overlay' it
+ * is a file, which is reused by later runs with the same base image:
+ *
+ *   +--------+--------------------+---------------------------------+
+ *   | header | allocation bitmap  | blocks, at block_idx*BLOCK_SIZE |
+ *   +--------+--------------------+---------------------------------+
+ *
+ * Each part starts at a page boundary, and unallocated blocks are holes.
+ */
+
+#define BLOCK_WIDTH 12
+#define BLOCK_SIZE (1 << BLOCK_WIDTH)
+#define OVERLAY_MAGIC "NEMUCOW1"
+
+typedef struct {
+	char magic[8];
+	uint32_t block_size;
+	uint32_t nr_block;
+	uint64_t base_size;
+} Overlay_header;
+
+static const char *base_path;
+static uint8_t *base;
+static size_t base_size;
+
+static uint32_t nr_block;
+static uint8_t *overlay;		/* the whole overlay */
+static size_t overlay_size;
+static Overlay_header *header;
+static uint8_t *bitmap;
+static uint8_t *blocks;
+
+#define ROUNDUP(a, sz) (((a) + (sz) - 1) & ~((sz) - 1))
+
+static inline bool block_allocated(uint32_t idx) {
+	return (bitmap[idx >> 3] >> (idx & 7)) & 1;
+}
+
+/* Copy the block up from the base image to the overlay. */
+static void alloc_block(uint32_t idx) {
+	size_t offset = (size_t)idx << BLOCK_WIDTH;
+	size_t valid = 0;
+	if(offset < base_size) {
+		valid = (base_size - offset < BLOCK_SIZE ? base_size - offset : BLOCK_SIZE);
+		memcpy(blocks + offset, base + offset, valid);
+	}
+	memset(blocks + offset + valid, 0, BLOCK_SIZE - valid);
+	bitmap[idx >> 3] |= 1 << (idx & 7);
+}
+
+void disk_read(void *buf, uint32_t offset, size_t len) {
+	while(len > 0) {
+		uint32_t idx = offset >> BLOCK_WIDTH;
+		size_t n = BLOCK_SIZE - (offset & (BLOCK_SIZE - 1));
+		if(n > len) { n = len; }
+
+		if(idx < nr_block && block_allocated(idx)) {
+			memcpy(buf, blocks + offset, n);
+		}
+		else {
+			size_t valid = 0;
+			if(offset < base_size) {
+				valid = (offset + n <= base_size ? n : base_size - offset);
+				memcpy(buf, base + offset, valid);
+			}
+			/* beyond the end of the image */
+			memset(buf + valid, 0, n - valid);
+		}
+
+		buf += n;
+		offset += n;
+		len -= n;
+	}
+}
+
+/* The size of the base image. The disk does not grow, and the IDE
+ * controller rejects the writes beyond it.
+ */
+size_t disk_size() {
+	return base_size;
+}
+
+void disk_write(const void *buf, uint32_t offset, size_t len) {
+	Assert(offset + len <= (size_t)nr_block << BLOCK_WIDTH,
+			"disk write [0x%x, 0x%zx) is outside of the disk", offset, offset + len);
+	while(len > 0) {
+		uint32_t idx = offset >> BLOCK_WIDTH;
+		size_t n = BLOCK_SIZE - (offset & (BLOCK_SIZE - 1));
+		if(n > len) { n = len; }
+
+		if(!block_allocated(idx)) {
+			alloc_block(idx);
+		}
+		memcpy(blocks + offset, buf, n);
+
+		buf += n;
+		offset += n;
+		len -= n;
+	}
+}
+
+/* Drop all the blocks in the overlay. */
+static void overlay_drop() {
+	memset(bitmap, 0, ROUNDUP(nr_block, 8) / 8);
+	madvise(blocks, (size_t)nr_block << BLOCK_WIDTH, MADV_REMOVE);
+	madvise(blocks, (size_t)nr_block << BLOCK_WIDTH, MADV_DONTNEED);
+}
+
+/* Write the blocks in the overlay back to the base image, then drop them. */
+void disk_commit() {
+	if(base == NULL) {
+		printf("No disk.\n");
+		return;
+	}
+
+	int fd = open(base_path, O_WRONLY);
+	Assert(fd >= 0, "Can not open '%s' for writing", base_path);
+
+	uint32_t idx, nr_commit = 0;
+	for(idx = 0; idx < nr_block; idx ++) {
+		if(block_allocated(idx)) {
+			size_t offset = (size_t)idx << BLOCK_WIDTH;
+			size_t len = (base_size - offset < BLOCK_SIZE ? base_size - offset : BLOCK_SIZE);
+			ssize_t ret = pwrite(fd, blocks + offset, len, offset);
+			Assert(ret == len, "Can not write back block %d", idx);
+			nr_commit ++;
+		}
+	}
+	fsync(fd);
+	close(fd);
+
+	/* The shared mapping of the base image sees the new content. */
+	overlay_drop();
+	printf("%d blocks are committed to '%s'\n", nr_commit, base_path);
+}
+
+void disk_discard() {
+	if(base == NULL) {
+		printf("No disk.\n");
+		return;
+	}
+
+	overlay_drop();
+	printf("The disk overlay is discarded.\n");
+}
+
+void disk_info() {
+	if(base == NULL) {
+		printf("No disk.\n");
+		return;
+	}
+
+	uint32_t idx, nr_alloc = 0;
+	for(idx = 0; idx < nr_block; idx ++) {
+		nr_alloc += block_allocated(idx);
+	}
+	printf("base image\t%s (%zd bytes)\n", base_path, base_size);
+	printf("overlay\t\t%d of %d blocks allocated (%d KB)\n", nr_alloc, nr_block,
+			nr_alloc * (BLOCK_SIZE >> 10));
+}
+
+void init_disk(const char *path, const char *overlay_path) {
+	base_path = path;
+	int fd = open(path, O_RDONLY);
+	Assert(fd >= 0, "Can not open '%s'", path);
+
+	struct stat st;
+	int ret = fstat(fd, &st);
+	assert(ret == 0);
+	base_size = st.st_size;
+	assert(base_size > 0);
+
+	base = mmap(NULL, base_size, PROT_READ, MAP_SHARED, fd, 0);
+	Assert(base != MAP_FAILED, "Can not map '%s'", path);
+	close(fd);
+
+	nr_block = ROUNDUP(base_size, BLOCK_SIZE) >> BLOCK_WIDTH;
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t header_size = ROUNDUP(sizeof(Overlay_header), page_size);
+	size_t bitmap_size = ROUNDUP(ROUNDUP(nr_block, 8) / 8, page_size);
+	overlay_size = header_size + bitmap_size + ((size_t)nr_block << BLOCK_WIDTH);
+
+	if(overlay_path == NULL) {
+		overlay = mmap(NULL, overlay_size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		Assert(overlay != MAP_FAILED, "Can not allocate the disk overlay");
+	}
+	else {
+		fd = open(overlay_path, O_RDWR | O_CREAT, 0644);
+		Assert(fd >= 0, "Can not open '%s'", overlay_path);
+		ret = fstat(fd, &st);
+		assert(ret == 0);
+		bool is_new = (st.st_size == 0);
+		if(is_new) {
+			/* a sparse file */
+			ret = ftruncate(fd, overlay_size);
+			Assert(ret == 0, "Can not create the overlay '%s'", overlay_path);
+		}
+		else {
+			Assert(st.st_size == overlay_size, "'%s' is not an overlay of '%s'", overlay_path, path);
+		}
+
+		overlay = mmap(NULL, overlay_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		Assert(overlay != MAP_FAILED, "Can not map '%s'", overlay_path);
+		close(fd);
+
+		if(!is_new) {
+			Overlay_header *h = (void *)overlay;
+			Assert(memcmp(h->magic, OVERLAY_MAGIC, 8) == 0 && h->block_size == BLOCK_SIZE &&
+					h->nr_block == nr_block && h->base_size == base_size,
+					"'%s' is not an overlay of '%s'", overlay_path, path);
+		}
+	}
+
+	header = (void *)overlay;
+	memcpy(header->magic, OVERLAY_MAGIC, 8);
+	header->block_size = BLOCK_SIZE;
+	header->nr_block = nr_block;
+	header->base_size = base_size;
+
+	bitmap = overlay + header_size;
+	blocks = overlay + header_size + bitmap_size;
+}
+
+/* The overlay in the save-state: the number of blocks, the bitmap, and
+ * the allocated blocks in order.
+ */
+void disk_save() {
+	size_t bitmap_len = ROUNDUP(nr_block, 8) / 8;
+	uint32_t idx, nr_alloc = 0;
+	for(idx = 0; idx < nr_block; idx ++) {
+		nr_alloc += block_allocated(idx);
+	}
+
+	size_t len = sizeof(uint32_t) + bitmap_len + ((size_t)nr_alloc << BLOCK_WIDTH);
+	uint8_t *buf = malloc(len), *p = buf;
+	assert(buf);
+	memcpy(p, &nr_block, sizeof(uint32_t));
+	p += sizeof(uint32_t);
+	memcpy(p, bitmap, bitmap_len);
+	p += bitmap_len;
+	for(idx = 0; idx < nr_block; idx ++) {
+		if(block_allocated(idx)) {
+			memcpy(p, blocks + ((size_t)idx << BLOCK_WIDTH), BLOCK_SIZE);
+			p += BLOCK_SIZE;
+		}
+	}
+	savestate_put("DISK", buf, len);
+	free(buf);
+}
+
+void disk_load() {
+	size_t len;
+	const uint8_t *p = savestate_get("DISK", &len);
+	Assert(p && *(uint32_t *)p == nr_block, "the save-state is not for this disk");
+	p += sizeof(uint32_t);
+
+	size_t bitmap_len = ROUNDUP(nr_block, 8) / 8;
+	overlay_drop();
+	memcpy(bitmap, p, bitmap_len);
+	p += bitmap_len;
+
+	uint32_t idx;
+	for(idx = 0; idx < nr_block; idx ++) {
+		if(block_allocated(idx)) {
+			memcpy(blocks + ((size_t)idx << BLOCK_WIDTH), p, BLOCK_SIZE);
+			p += BLOCK_SIZE;
+		}
+	}
+}
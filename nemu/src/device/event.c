@@ -0,0 +1,86 @@
+#include "device/event.h"
+
+#include <stdlib.h>
+
+#define NR_EVENT 16
+
+typedef struct event {
+	uint64_t time;
+	event_callback_t callback;
+	void *arg;
+	struct event *next;
+} Event;
+
+static machine_local Event event_pool[NR_EVENT];
+static machine_local Event *head, *free_ = NULL;
+
+/* the time of the earliest pending event */
+machine_local uint64_t next_event_time = -1ull;
+
+void init_event() {
+	int i;
+	for(i = 0; i < NR_EVENT - 1; i ++) {
+		event_pool[i].next = &event_pool[i + 1];
+	}
+	event_pool[NR_EVENT - 1].next = NULL;
+	free_ = event_pool;
+	head = NULL;
+	next_event_time = -1ull;
+}
+
+/* Call `callback(arg)' after `delay' instructions. */
+void add_event(uint64_t delay, event_callback_t callback, void *arg) {
+	Assert(free_, "There is no more event.");
+	Event *e = free_;
+	free_ = free_->next;
+	e->time = nr_instr + delay;
+	e->callback = callback;
+	e->arg = arg;
+
+	/* keep the list sorted by time */
+	Event **p;
+	for(p = &head; *p && (*p)->time <= e->time; p = &(*p)->next);
+	e->next = *p;
+	*p = e;
+
+	next_event_time = head->time;
+}
+
+void handle_events() {
+	while(head && head->time <= nr_instr) {
+		Event *e = head;
+		head = e->next;
+		next_event_time = (head ? head->time : -1ull);
+
+		e->next = free_;
+		free_ = e;
+
+		/* The callback may add new events. */
+		e->callback(e->arg);
+	}
+}
+
+/* The whole queue, for the checkpoints of reverse execution. The
+ * callbacks and their arguments are only valid in this process.
+ */
+typedef struct {
+	Event pool[NR_EVENT];
+	Event *head, *free_;
+} EventQueue;
+
+void *event_save() {
+	EventQueue *q = malloc(sizeof(*q));
+	assert(q);
+	memcpy(q->pool, event_pool, sizeof(event_pool));
+	q->head = head;
+	q->free_ = free_;
+	return q;
+}
+
+void event_load(const void *p) {
+	const EventQueue *q = p;
+	memcpy(event_pool, q->pool, sizeof(event_pool));
+	head = q->head;
+	free_ = q->free_;
+	next_event_time = (head ? head->time : -1ull);
+}
@@ -1,5 +1,6 @@
 #include "common.h"
 #include "cpu/reg.h"
+#include "monitor/savestate.h"
 
 #define IRQ_BASE 32
 #define NO_INTR -1
@@ -104,3 +105,21 @@ void i8259_ack_intr() {
 
 	do_i8259();
 }
+
+typedef struct {
+	i8259 master, slave;
+	uint8_t intr_NO;
+} i8259_state;
+
+void i8259_save() {
+	i8259_state s = { master, slave, intr_NO };
+	savestate_put("8259", &s, sizeof(s));
+}
+
+void i8259_load() {
+	i8259_state s;
+	savestate_get_copy("8259", &s, sizeof(s));
+	master = s.master;
+	slave = s.slave;
+	intr_NO = s.intr_NO;
+}
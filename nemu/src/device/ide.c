@@ -2,6 +2,16 @@
 #include "memory/memory.h"
 #include "device/port-io.h"
 #include "device/i8259.h"
+#include "device/event.h"
+#include "device/disk.h"
+#include "cpu/ifetch.h"
+#include "memory/vmem-dirty.h"
+#include "monitor/savestate.h"
+#include "monitor/checkpoint.h"
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <signal.h>
 
 #define IDE_CTRL_PORT 0x3F6
 #define IDE_PORT 0x1F0
@@ -9,127 +19,371 @@
 
 #define IDE_IRQ 14
 
+#define SECTOR_SIZE 512
+
+/* ATA commands */
+#define CMD_READ_SECTORS	0x20
+#define CMD_WRITE_SECTORS	0x30
+#define CMD_READ_MULTIPLE	0xc4
+#define CMD_WRITE_MULTIPLE	0xc5
+#define CMD_READ_DMA		0xc8
+#define CMD_WRITE_DMA		0xca
+
+#define STATUS_ERR 0x01
+#define STATUS_READY 0x40
+#define STATUS_BUSY 0x80
+
+/* error register */
+#define ERROR_IDNF 0x10		/* the sector is not found */
+
+/* bus master command register */
+#define BMR_START 0x1
+#define BMR_READ 0x8		/* read from disk, i.e. write to memory */
+
+/* bus master status register */
+#define BMR_ACTIVE 0x1
+#define BMR_ERROR 0x2
+#define BMR_INTR 0x4
+
 static uint8_t *ide_port_base;
 static uint8_t *bmr_base;	/* bus master registers */
 
-static uint32_t sector, disk_idx;
-static uint32_t byte_cnt;
+static uint32_t disk_idx;
+static uint32_t byte_cnt;	/* bytes left in the current PIO transfer */
 static bool ide_write;
-static FILE *disk_fp;
+
+/* the file to keep the disk overlay, NULL for memory */
+const char *disk_overlay = NULL;
+
+static inline uint32_t get_sector() {
+	return (ide_port_base[6] & 0x1f) << 24 | ide_port_base[5] << 16
+		| ide_port_base[4] << 8 | ide_port_base[3];
+}
+
+/* A sector count of 0 means 256 sectors. */
+static inline uint32_t get_sector_cnt() {
+	return (ide_port_base[2] == 0 ? 256 : ide_port_base[2]);
+}
+
+/* A write beyond the end of the disk image is aborted with IDNF,
+ * as a real drive does for a sector beyond its capacity.
+ */
+static inline bool write_out_of_disk(uint32_t offset, uint32_t len) {
+	return (uint64_t)offset + len > disk_size();
+}
+
+/* After an aborted command, the guest may still move the data it meant
+ * to transfer. The data port is ignored until the next command.
+ */
+static inline bool ide_in_error() {
+	return ide_port_base[7] & STATUS_ERR;
+}
+
+static void ide_error() {
+	ide_port_base[1] = ERROR_IDNF;
+	ide_port_base[7] = STATUS_READY | STATUS_ERR;
+	i8259_raise_intr(IDE_IRQ);
+}
 
 void ide_io_handler(ioaddr_t addr, size_t len, bool is_write) {
-	assert(byte_cnt <= 512);
-	int ret;
 	if(is_write) {
 		if(addr - IDE_PORT == 0 && len == 4) {
 			/* write 4 bytes data to disk */
-			assert(ide_write);
-			ret = fwrite(ide_port_base, 4, 1, disk_fp);
-			assert(ret == 1);
+			if(ide_in_error()) { return; }
+			assert(ide_write && byte_cnt > 0);
+			disk_write(ide_port_base, disk_idx, 4);
 
-			byte_cnt += 4;
-			if(byte_cnt == 512) {
+			disk_idx += 4;
+			byte_cnt -= 4;
+			if(byte_cnt == 0) {
 				/* finish */
-				ide_port_base[7] = 0x40;
+				ide_port_base[7] = STATUS_READY;
 			}
 		}
 		else if(addr - IDE_PORT == 7) {
-			if(ide_port_base[7] == 0x20 || ide_port_base[7] == 0x30) {
-				/* command: read/write */
-				sector = (ide_port_base[6] & 0x1f) << 24 | ide_port_base[5] << 16
-					| ide_port_base[4] << 8 | ide_port_base[3];
-				disk_idx = sector << 9;
-				fseek(disk_fp, disk_idx, SEEK_SET);
-
-				byte_cnt = 0;
-
-				if(ide_port_base[7] == 0x20) {
-					/* command: read from disk */
-					ide_write = false;
-					ide_port_base[7] = 0x40;
-					i8259_raise_intr(IDE_IRQ);
-				}
-				else {
-					/* command: write to disk */
-					ide_write = true;
-				}
-			}
-			else if (ide_port_base[7] == 0xc8) {
-				/* command: DMA read */
+			switch(ide_port_base[7]) {
+				case CMD_READ_SECTORS:
+				case CMD_READ_MULTIPLE:
+				case CMD_WRITE_SECTORS:
+				case CMD_WRITE_MULTIPLE:
+					disk_idx = get_sector() * SECTOR_SIZE;
+					byte_cnt = get_sector_cnt() * SECTOR_SIZE;
 
-				/* Nothing to do here. The actual read operation is
-				 * issued by write commands to the bus master register. */
-			}
-			else {
-				/* not implemented command */
-				assert(0);
+					if(ide_port_base[7] == CMD_READ_SECTORS || ide_port_base[7] == CMD_READ_MULTIPLE) {
+						/* command: read from disk */
+						ide_write = false;
+						ide_port_base[7] = STATUS_READY;
+						i8259_raise_intr(IDE_IRQ);
+					}
+					else if(write_out_of_disk(disk_idx, byte_cnt)) {
+						ide_write = false;
+						byte_cnt = 0;
+						ide_error();
+					}
+					else {
+						/* command: write to disk */
+						ide_write = true;
+					}
+					break;
+
+				case CMD_READ_DMA:
+				case CMD_WRITE_DMA:
+					/* Nothing to do here. The actual transfer is issued
+					 * by write commands to the bus master register. */
+					break;
+
+				default:
+					/* not implemented command */
+					assert(0);
 			}
 		}
 	}
 	else {
 		if(addr - IDE_PORT == 0 && len == 4) {
 			/* read 4 bytes data from disk */
-			assert(!ide_write);
-			ret = fread(ide_port_base, 4, 1, disk_fp);
-			assert(ret == 1 || feof(disk_fp));
+			if(ide_in_error()) { return; }
+			assert(!ide_write && byte_cnt > 0);
+			disk_read(ide_port_base, disk_idx, 4);
 
-			byte_cnt += 4;
-			if(byte_cnt == 512) {
+			disk_idx += 4;
+			byte_cnt -= 4;
+			if(byte_cnt == 0) {
 				/* finish */
-				ide_port_base[7] = 0x40;
+				ide_port_base[7] = STATUS_READY;
 			}
 		}
 	}
 }
 
-void bmr_io_handler(ioaddr_t addr, size_t len, bool is_write) {
-	int ret;
-	if(is_write) {
-		if(addr - BMR_PORT == 0) {
-			if(bmr_base[0] & 0x1) {
-				/* DMA start command */
-				if(bmr_base[0] & 0x8) {
-					/* DMA read */
+/* DMA transfers are performed by a host worker thread, and complete
+ * after `ide_latency' instructions of virtual time, so that the guest
+ * can compute while the disk is busy. The worker only touches the disk
+ * image and a bounce buffer. Guest memory is only accessed by the CPU
+ * thread, when the command is issued and when it completes.
+ * With `ide_latency == 0' the transfer completes immediately.
+ */
+uint32_t ide_latency = 0;
 
-					/* the address of Physical Region Descriptor Table */
-					hwaddr_t prdt_addr = *(uint32_t *)(bmr_base + 4);
+#define NR_PRD 64
 
-					hwaddr_t addr = hwaddr_read(prdt_addr, 4);
-					uint32_t hi_entry = hwaddr_read(prdt_addr + 4, 4);
-					uint16_t byte_cnt = hi_entry & 0xffff;
+typedef struct {
+	bool to_memory;
+	uint32_t disk_offset;
+	int nr_region;
+	struct {
+		hwaddr_t addr;
+		uint32_t cnt;
+	} region[NR_PRD];
+	uint32_t total;
+	uint8_t *bounce;
+	bool busy;
+	bool done;
+} DMA_req;
 
-					sector = (ide_port_base[6] & 0x1f) << 24 | ide_port_base[5] << 16
-						| ide_port_base[4] << 8 | ide_port_base[3];
-					disk_idx = sector << 9;
-					fseek(disk_fp, disk_idx, SEEK_SET);
+static DMA_req dma;
 
-					ret = fread((void *)hwa_to_va(addr), byte_cnt, 1, disk_fp);
-					assert(ret == 1 || feof(disk_fp));
+static pthread_t worker;
+static pthread_mutex_t dma_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dma_issued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t dma_finished = PTHREAD_COND_INITIALIZER;
 
-					/* We only implement PRDT of single entry. */
-					assert(hi_entry & 0x80000000);
+static void dma_transfer() {
+	if(dma.to_memory) { disk_read(dma.bounce, dma.disk_offset, dma.total); }
+	else { disk_write(dma.bounce, dma.disk_offset, dma.total); }
+}
 
-					/* finish */
-					ide_port_base[7] = 0x40;
-					i8259_raise_intr(IDE_IRQ);
-				}
-				else {
-					/* DMA write is not implemented */
-					assert(0);
-				}
+static void *dma_worker(void *arg) {
+	pthread_mutex_lock(&dma_lock);
+	while(1) {
+		while(!(dma.busy && !dma.done)) {
+			pthread_cond_wait(&dma_issued, &dma_lock);
+		}
+		pthread_mutex_unlock(&dma_lock);
+
+		dma_transfer();
+
+		pthread_mutex_lock(&dma_lock);
+		dma.done = true;
+		pthread_cond_signal(&dma_finished);
+	}
+	return NULL;
+}
+
+static void dma_complete(void *arg) {
+	pthread_mutex_lock(&dma_lock);
+	while(!dma.done) {
+		pthread_cond_wait(&dma_finished, &dma_lock);
+	}
+	pthread_mutex_unlock(&dma_lock);
+
+	if(dma.to_memory) {
+		/* scatter */
+		int i;
+		uint8_t *p = dma.bounce;
+		for(i = 0; i < dma.nr_region; i ++) {
+			checkpoint_check_write(dma.region[i].addr, dma.region[i].cnt);
+			memcpy(hwa_to_va(dma.region[i].addr), p, dma.region[i].cnt);
+			vmem_check_write(dma.region[i].addr, dma.region[i].cnt);
+			p += dma.region[i].cnt;
+		}
+		ifb_flush();
+	}
+
+	free(dma.bounce);
+	dma.busy = false;
+
+	/* finish */
+	bmr_base[2] = (bmr_base[2] & ~BMR_ACTIVE) | BMR_INTR;
+	ide_port_base[7] = STATUS_READY;
+	i8259_raise_intr(IDE_IRQ);
+}
+
+/* Walk the Physical Region Descriptor Table to collect the regions.
+ * Each entry is 8 bytes: the physical address of the region, the byte
+ * count (0 means 64KB) in the low 16 bits of the second word, and the
+ * end-of-table flag in bit 31.
+ */
+static void dma_issue(bool to_memory) {
+	if(dma.busy) {
+		/* a second start while a transfer is in flight is refused */
+		bmr_base[2] |= BMR_ERROR;
+		return;
+	}
+	hwaddr_t prdt_addr = *(uint32_t *)(bmr_base + 4);
+
+	dma.to_memory = to_memory;
+	dma.disk_offset = get_sector() * SECTOR_SIZE;
+	dma.nr_region = 0;
+	dma.total = 0;
+
+	uint32_t hi_entry;
+	do {
+		Assert(dma.nr_region < NR_PRD, "too many entries in PRDT");
+		hwaddr_t addr = hwaddr_read(prdt_addr, 4);
+		hi_entry = hwaddr_read(prdt_addr + 4, 4);
+		uint32_t cnt = hi_entry & 0xffff;
+		if(cnt == 0) { cnt = 0x10000; }
+
+		Assert(addr + cnt <= HW_MEM_SIZE, "DMA region [0x%x, 0x%x) is outside of the physical memory",
+				addr, addr + cnt);
+		dma.region[dma.nr_region].addr = addr;
+		dma.region[dma.nr_region].cnt = cnt;
+		dma.nr_region ++;
+		dma.total += cnt;
+		prdt_addr += 8;
+	} while(!(hi_entry & 0x80000000));
+
+	if(!to_memory && write_out_of_disk(dma.disk_offset, dma.total)) {
+		bmr_base[2] = (bmr_base[2] & ~BMR_ACTIVE) | BMR_ERROR | BMR_INTR;
+		ide_error();
+		return;
+	}
+
+	dma.bounce = malloc(dma.total);
+	assert(dma.bounce);
+
+	if(!to_memory) {
+		/* gather */
+		int i;
+		uint8_t *p = dma.bounce;
+		for(i = 0; i < dma.nr_region; i ++) {
+			memcpy(p, hwa_to_va(dma.region[i].addr), dma.region[i].cnt);
+			p += dma.region[i].cnt;
+		}
+	}
+
+	bmr_base[2] |= BMR_ACTIVE;
+	ide_port_base[7] = STATUS_BUSY;
+
+	if(ide_latency == 0) {
+		dma.busy = true;
+		dma_transfer();
+		dma.done = true;
+		dma_complete(NULL);
+	}
+	else {
+		pthread_mutex_lock(&dma_lock);
+		dma.busy = true;
+		dma.done = false;
+		pthread_cond_signal(&dma_issued);
+		pthread_mutex_unlock(&dma_lock);
+
+		add_event(ide_latency, dma_complete, NULL);
+	}
+}
+
+void bmr_io_handler(ioaddr_t addr, size_t len, bool is_write) {
+	if(is_write) {
+		if(addr - BMR_PORT == 0) {
+			if(bmr_base[0] & BMR_START) {
+				/* DMA start command */
+				dma_issue(bmr_base[0] & BMR_READ);
 			}
 		}
 	}
 }
 
+/* The timer signal must be delivered to the CPU thread, so the worker
+ * is created with it blocked, as the render thread is.
+ */
+static void start_worker() {
+	sigset_t set, old;
+	sigemptyset(&set);
+	sigaddset(&set, SIGVTALRM);
+	pthread_sigmask(SIG_BLOCK, &set, &old);
+	int ret = pthread_create(&worker, NULL, dma_worker, NULL);
+	Assert(ret == 0, "Can not create the DMA worker thread");
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+/* Only the calling thread survives fork() (see monitor/snapshot.c),
+ * so the child starts a new worker. A transfer in flight is redone.
+ */
+static void ide_atfork_child() {
+	pthread_mutex_init(&dma_lock, NULL);
+	pthread_cond_init(&dma_issued, NULL);
+	pthread_cond_init(&dma_finished, NULL);
+	start_worker();
+}
+
 void init_ide() {
 	ide_port_base = add_pio_map(IDE_PORT, 8, ide_io_handler);
-	ide_port_base[7] = 0x40;
+	ide_port_base[7] = STATUS_READY;
 
 	bmr_base = add_pio_map(BMR_PORT, 8, bmr_io_handler);
 	bmr_base[0] = 0;
 
+	/* The disk is a copy-on-write overlay of the program image. */
 	extern char *exec_file;
-	disk_fp = fopen(exec_file, "r+");
-	Assert(disk_fp, "Can not open '%s'", exec_file);
+	init_disk(exec_file, disk_overlay);
+
+	if(ide_latency != 0) {
+		start_worker();
+		pthread_atfork(NULL, NULL, ide_atfork_child);
+	}
+}
+
+typedef struct {
+	uint32_t disk_idx, byte_cnt;
+	bool ide_write;
+} IDE_state;
+
+/* A DMA transfer in flight can not be saved. */
+bool ide_busy() {
+	return dma.busy;
+}
+
+void ide_save() {
+	IDE_state s = { disk_idx, byte_cnt, ide_write };
+	savestate_put("IDE ", &s, sizeof(s));
+	if(!savestate_in_memory) { disk_save(); }
+}
+
+void ide_load() {
+	IDE_state s;
+	savestate_get_copy("IDE ", &s, sizeof(s));
+	disk_idx = s.disk_idx;
+	byte_cnt = s.byte_cnt;
+	ide_write = s.ide_write;
+	if(!savestate_in_memory) { disk_load(); }
 }
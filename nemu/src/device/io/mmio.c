@@ -1,12 +1,16 @@
 #include "common.h"
 #include "device/mmio.h"
 #include "misc.h"
+#include "monitor/savestate.h"
+
+#include <stdlib.h>
 
 #define MMIO_SPACE_MAX (256 * 1024)
 #define NR_MAP 8
 
-static uint8_t mmio_space_pool[MMIO_SPACE_MAX];
-static uint32_t mmio_space_free_index = 0;
+/* allocated by the first map, so that the thread-local block stays small */
+static machine_local uint8_t *mmio_space_pool;
+static machine_local uint32_t mmio_space_free_index = 0;
 
 typedef struct {
 	hwaddr_t low;
@@ -15,13 +19,17 @@ typedef struct {
 	mmio_callback_t callback;
 } MMIO_t;
 
-static MMIO_t maps[NR_MAP];
-static int nr_map = 0;
+static machine_local MMIO_t maps[NR_MAP];
+static machine_local int nr_map = 0;
 
 /* device interface */
 void* add_mmio_map(hwaddr_t addr, size_t len, mmio_callback_t callback) {
 	assert(nr_map < NR_MAP);
 	assert(mmio_space_free_index + len <= MMIO_SPACE_MAX);
+	if(mmio_space_pool == NULL) {
+		mmio_space_pool = calloc(MMIO_SPACE_MAX, 1);
+		assert(mmio_space_pool);
+	}
 
 	uint8_t *space_base = &mmio_space_pool[mmio_space_free_index];
 	maps[nr_map].low = addr;
@@ -44,11 +52,20 @@ int is_mmio(hwaddr_t addr) {
 	return -1;
 }
 
+/* is_mmio() only checks the first byte, an access must not run into
+ * the space of the next map
+ */
+static inline void check_in_map(hwaddr_t addr, size_t len, MMIO_t *map) {
+	Assert(addr + len - 1 <= map->high, "MMIO access [0x%x, 0x%x) crosses the end of the map [0x%x, 0x%x]",
+			addr, addr + (uint32_t)len, map->low, map->high);
+}
+
 uint32_t mmio_read(hwaddr_t addr, size_t len, int map_NO) {
 	assert(len == 1 || len == 2 || len == 4);
 	MMIO_t *map = &maps[map_NO];
-	uint32_t data = *(uint32_t *)(map->mmio_space + (addr - map->low)) 
-		& (~0u >> ((4 - len) << 3));
+	check_in_map(addr, len, map);
+	uint32_t data = 0;
+	memcpy(&data, map->mmio_space + (addr - map->low), len);
 	map->callback(addr, len, false);
 	return data;
 }
@@ -56,7 +73,16 @@ uint32_t mmio_read(hwaddr_t addr, size_t len, int map_NO) {
 void mmio_write(hwaddr_t addr, size_t len, uint32_t data, int map_NO) {
 	assert(len == 1 || len == 2 || len == 4);
 	MMIO_t *map = &maps[map_NO];
+	check_in_map(addr, len, map);
 	uint32_t mask = (~0u >> ((4 - len) << 3));
 	memcpy_with_mask(map->mmio_space + (addr - map->low), &data, len, (void *)&mask);
 	maps[map_NO].callback(addr, len, true);
 }
+
+void mmio_save() {
+	savestate_put("MMIO", mmio_space_pool, mmio_space_free_index);
+}
+
+void mmio_load() {
+	savestate_get_copy("MMIO", mmio_space_pool, mmio_space_free_index);
+}
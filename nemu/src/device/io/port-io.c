@@ -1,11 +1,16 @@
 #include "common.h"
 #include "device/port-io.h"
+#include "monitor/savestate.h"
+
+#include <stdlib.h>
 
 #define PORT_IO_SPACE_MAX 65536
 #define NR_MAP 8
 
-/* "+ 3" is for hacking, see pio_read() below */
-static uint8_t pio_space[PORT_IO_SPACE_MAX + 3];
+/* "+ 3" is for hacking, see pio_read() below.
+ * It is on the heap, so that the thread-local block stays small.
+ */
+static machine_local uint8_t *pio_space;
 
 typedef struct {
 	ioaddr_t low;
@@ -13,8 +18,8 @@ typedef struct {
 	pio_callback_t callback;
 } PIO_t;
 
-static PIO_t maps[NR_MAP];
-static int nr_map = 0;
+static machine_local PIO_t maps[NR_MAP];
+static machine_local int nr_map = 0;
 
 static void pio_callback(ioaddr_t addr, size_t len, bool is_write) {
 	int i;
@@ -26,6 +31,14 @@ static void pio_callback(ioaddr_t addr, size_t len, bool is_write) {
 	}
 }
 
+/* called by init_machine(), the space is kept for the next machine of the thread */
+void init_port_io() {
+	if(pio_space == NULL) {
+		pio_space = calloc(PORT_IO_SPACE_MAX + 3, 1);
+		assert(pio_space);
+	}
+}
+
 /* device interface */
 void* add_pio_map(ioaddr_t addr, size_t len, pio_callback_t callback) {
 	assert(nr_map < NR_MAP);
@@ -54,3 +67,28 @@ void pio_write(ioaddr_t addr, size_t len, uint32_t data) {
 	pio_callback(addr, len, true);
 }
 
+/* The registers of all the mapped ports, in the order of the maps. */
+void pio_save() {
+	uint8_t *buf = malloc(PORT_IO_SPACE_MAX);
+	assert(buf);
+	int i, len = 0;
+	for(i = 0; i < nr_map; i ++) {
+		int n = maps[i].high - maps[i].low + 1;
+		memcpy(buf + len, pio_space + maps[i].low, n);
+		len += n;
+	}
+	savestate_put("PIO ", buf, len);
+	free(buf);
+}
+
+void pio_load() {
+	size_t size;
+	const uint8_t *p = savestate_get("PIO ", &size);
+	int i, len = 0;
+	for(i = 0; i < nr_map; i ++) {
+		int n = maps[i].high - maps[i].low + 1;
+		Assert(p && len + n <= size, "the save-state does not match the ports");
+		memcpy(pio_space + maps[i].low, p + len, n);
+		len += n;
+	}
+}
@@ -0,0 +1,156 @@
+#include "common.h"
+
+/* Scripted keyboard input. Each line of the script is
+ *   WHEN ACTION KEY
+ * where WHEN is the number of instructions retired, or "f" followed by
+ * the number of screen refreshes; ACTION is "down", "up" or "press"
+ * (down and then up); KEY is a printable character, one of the names
+ * below, or a scancode like "0x1e". Lines starting with '#' are ignored.
+ * Events must be in the order of time. For example:
+ *   # start the game and move left for a while
+ *   f50      press ENTER
+ *   2000000  down  LEFT
+ *   f300     up    LEFT
+ * The keys are sent through the i8042 as if they were typed, so the
+ * same script gives the same run.
+ */
+
+/* set by the command line options */
+const char *key_script = NULL;
+
+#ifdef HAS_DEVICE
+
+#include "sdl.h"
+#include "device/event.h"
+
+#include <stdlib.h>
+
+#define NR_KEY_EVENT 4096
+
+enum { KEY_DOWN = 1, KEY_UP = 2, KEY_PRESS = KEY_DOWN | KEY_UP };
+
+typedef struct {
+	bool by_frame;
+	uint64_t when;
+	int action;
+	uint8_t scancode;
+} KeyEvent;
+
+static KeyEvent events[NR_KEY_EVENT];
+static int nr_event, next;
+
+/* the number of screen refreshes so far */
+static uint64_t nr_frame;
+
+static const struct {
+	const char *name;
+	uint8_t scancode;
+} key_names[] = {
+	{ "ESC", K_ESC }, { "ENTER", K_ENTER }, { "SPACE", K_SPACE }, { "TAB", K_TAB },
+	{ "BACK", K_BACK }, { "UP", K_UP }, { "DOWN", K_DOWN }, { "LEFT", K_LEFT },
+	{ "RIGHT", K_RIGHT }, { "LSHIFT", K_LSHIFT }, { "LCTRL", K_LCTRL }, { "LALT", K_LALT },
+	{ "F1", K_F1 }, { "F2", K_F2 }, { "F3", K_F3 }, { "F4", K_F4 },
+};
+
+#define NR_KEY_NAME (sizeof(key_names) / sizeof(key_names[0]))
+
+static uint8_t parse_key(const char *s, int lineno) {
+	int i;
+	if(s[0] != '\0' && s[1] == '\0' && (unsigned char)s[0] < 128 && sym2scancode[0][(int)s[0]] != UNDEF) {
+		return sym2scancode[0][(int)s[0]];
+	}
+	for(i = 0; i < NR_KEY_NAME; i ++) {
+		if(strcmp(s, key_names[i].name) == 0) {
+			return key_names[i].scancode;
+		}
+	}
+
+	char *end;
+	unsigned long scancode = strtoul(s, &end, 0);
+	Assert(*end == '\0' && scancode > 0 && scancode < 0x80,
+			"%s:%d: unknown key '%s'", key_script, lineno, s);
+	return scancode;
+}
+
+static void send(KeyEvent *e) {
+	extern void keyboard_intr(uint8_t);
+	if(e->action & KEY_DOWN) { keyboard_intr(e->scancode); }
+	if(e->action & KEY_UP) { keyboard_intr(e->scancode | 0x80); }
+}
+
+static void schedule_next();
+
+static void timed_event(void *arg) {
+	send(&events[next ++]);
+	schedule_next();
+}
+
+/* Send the events which are due. A timed event is sent from the event
+ * queue, and an event on a frame waits for key_script_frame().
+ */
+static void schedule_next() {
+	while(next < nr_event) {
+		KeyEvent *e = &events[next];
+		if(e->by_frame) {
+			if(e->when > nr_frame) { return; }
+		}
+		else if(e->when > nr_instr) {
+			add_event(e->when - nr_instr, timed_event, NULL);
+			return;
+		}
+		send(e);
+		next ++;
+	}
+}
+
+static void script_start(void *arg) {
+	schedule_next();
+}
+
+/* Called by the VGA device at each screen refresh. */
+void key_script_frame() {
+	nr_frame ++;
+	if(next < nr_event && events[next].by_frame) {
+		schedule_next();
+	}
+}
+
+void init_key_script() {
+	FILE *fp = fopen(key_script, "r");
+	Assert(fp, "Can not open '%s'", key_script);
+
+	char line[256];
+	int lineno = 0;
+	nr_event = 0;
+	while(fgets(line, sizeof(line), fp)) {
+		lineno ++;
+		char *when = strtok(line, " \t\n");
+		if(when == NULL || when[0] == '#') { continue; }
+		char *action = strtok(NULL, " \t\n");
+		char *key = strtok(NULL, " \t\n");
+		Assert(action && key, "%s:%d: expect 'WHEN ACTION KEY'", key_script, lineno);
+		Assert(nr_event < NR_KEY_EVENT, "too many events in '%s'", key_script);
+
+		KeyEvent *e = &events[nr_event];
+		e->by_frame = (when[0] == 'f');
+		char *end;
+		e->when = strtoull(when + e->by_frame, &end, 0);
+		Assert(*end == '\0', "%s:%d: invalid time '%s'", key_script, lineno, when);
+
+		if(strcmp(action, "down") == 0) { e->action = KEY_DOWN; }
+		else if(strcmp(action, "up") == 0) { e->action = KEY_UP; }
+		else if(strcmp(action, "press") == 0) { e->action = KEY_PRESS; }
+		else { panic("%s:%d: unknown action '%s'", key_script, lineno, action); }
+
+		e->scancode = parse_key(key, lineno);
+		nr_event ++;
+	}
+	fclose(fp);
+
+	next = 0;
+	nr_frame = 0;
+	/* start when the program is running */
+	add_event(0, script_start, NULL);
+}
+
+#endif	/* HAS_DEVICE */
@@ -1,29 +1,93 @@
 #include "device/port-io.h"
 #include "device/i8259.h"
+#include "device/event.h"
 #include "monitor/monitor.h"
+#include "monitor/savestate.h"
 
 #define I8042_DATA_PORT 0x60
 #define KEYBOARD_IRQ 1
 
+/* the number of instructions before the next scancode is sent */
+#define I8042_DELAY 100
+
 static uint8_t *i8042_data_port_base;
 static bool newkey;
+static bool sending;
 
-void keyboard_intr(uint8_t scancode) {
-	if(nemu_state == RUNNING && newkey == false) {
-		i8042_data_port_base[0] = scancode;
+/* Scancodes waiting for the output buffer. Keys arriving while the
+ * guest has not read the last one are kept here instead of dropped.
+ */
+#define NR_KEY_FIFO 16
+
+static uint8_t key_fifo[NR_KEY_FIFO];
+static int key_head, key_cnt;
+
+static void send_key(void *arg) {
+	sending = false;
+	if(key_cnt > 0) {
+		i8042_data_port_base[0] = key_fifo[key_head];
+		key_head = (key_head + 1) % NR_KEY_FIFO;
+		key_cnt --;
 		i8259_raise_intr(KEYBOARD_IRQ);
 		newkey = true;
 	}
 }
 
+void keyboard_intr(uint8_t scancode) {
+	if(nemu_state == RUNNING && key_cnt < NR_KEY_FIFO) {
+		key_fifo[(key_head + key_cnt) % NR_KEY_FIFO] = scancode;
+		key_cnt ++;
+		if(!newkey && !sending) {
+			send_key(NULL);
+		}
+	}
+}
+
 void i8042_io_handler(ioaddr_t addr, size_t len, bool is_write) {
-	if(!is_write) {
+	if(!is_write && newkey) {
+		/* The scancode in the buffer is being read, send the next one later. */
 		newkey = false;
+		if(key_cnt > 0 && !sending) {
+			sending = true;
+			add_event(I8042_DELAY, send_key, NULL);
+		}
 	}
 }
 
 void init_i8042() {
 	i8042_data_port_base = add_pio_map(I8042_DATA_PORT, 1, i8042_io_handler);
 	newkey = false;
+	sending = false;
+	key_head = key_cnt = 0;
+}
+
+typedef struct {
+	uint8_t fifo[NR_KEY_FIFO];
+	int head, cnt;
+	bool newkey;
+} i8042_state;
+
+void i8042_save() {
+	i8042_state s;
+	memcpy(s.fifo, key_fifo, NR_KEY_FIFO);
+	s.head = key_head;
+	s.cnt = key_cnt;
+	s.newkey = newkey;
+	savestate_put("KBD ", &s, sizeof(s));
 }
 
+void i8042_load() {
+	i8042_state s;
+	savestate_get_copy("KBD ", &s, sizeof(s));
+	memcpy(key_fifo, s.fifo, NR_KEY_FIFO);
+	key_head = s.head;
+	key_cnt = s.cnt;
+	newkey = s.newkey;
+
+	/* the pending event is not saved, send the next key again */
+	sending = false;
+	if(!newkey && key_cnt > 0) {
+		sending = true;
+		add_event(I8042_DELAY, send_key, NULL);
+	}
+}
@@ -4,13 +4,15 @@
 
 #include "sdl.h"
 #include "vga.h"
+#include "device/vga-scale.h"
+#include "monitor/replay.h"
 
 #include <sys/time.h>
 #include <signal.h>
+#include <pthread.h>
 
 SDL_Surface *real_screen;
-SDL_Surface *screen;
-uint8_t (*pixel_buf) [SCREEN_COL];
+uint32_t (*pixel_buf) [SCREEN_COL];
 
 #define TIMER_HZ 100
 
@@ -18,13 +20,13 @@ static uint64_t jiffy = 0;
 static struct itimerval it;
 static int device_update_flag = false;
 static int update_screen_flag = false;
-extern void timer_intr();
-extern void keyboard_intr();
-extern void update_screen();
+static int timer_flag = false;
+extern void device_input(int, uint8_t);
+extern void vga_present_frame(int);
 
 static void timer_sig_handler(int signum) {
 	jiffy ++;
-	timer_intr();
+	timer_flag = true;
 
 	device_update_flag = true;
 	if(jiffy % (TIMER_HZ / VGA_HZ) == 0) {
@@ -35,61 +37,150 @@ static void timer_sig_handler(int signum) {
 	Assert(ret == 0, "Can not set timer");
 }
 
+/* Keyboard events from the render thread to the CPU thread.
+ * This is a single-producer single-consumer ring, so that neither
+ * thread takes a lock.
+ */
+#define NR_INPUT 256
+#define INPUT_QUIT_EVENT 0x100
+
+static uint16_t input_queue[NR_INPUT];
+static uint32_t input_head, input_tail;	/* free-running, written by the consumer and the producer */
+
+static void input_push(uint16_t ev) {
+	uint32_t tail = input_tail;
+	if(tail - __atomic_load_n(&input_head, __ATOMIC_ACQUIRE) == NR_INPUT) {
+		/* full, drop the event */
+		return;
+	}
+	input_queue[tail % NR_INPUT] = ev;
+	__atomic_store_n(&input_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static bool input_pop(uint16_t *ev) {
+	uint32_t head = input_head;
+	if(head == __atomic_load_n(&input_tail, __ATOMIC_ACQUIRE)) {
+		return false;
+	}
+	*ev = input_queue[head % NR_INPUT];
+	__atomic_store_n(&input_head, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
 void device_update() {
+	if(replay_mode == REPLAY_PLAY) {
+		replay_update();
+	}
+
 	if(!device_update_flag) {
 		return;
 	}
 	device_update_flag = false;
 
-	if(update_screen_flag) {
-		update_screen();
-		update_screen_flag = false;
+	uint16_t ev;
+	if(replay_mode == REPLAY_PLAY) {
+		/* the recorded inputs only, but the window can still be closed */
+		timer_flag = update_screen_flag = false;
+		while(input_pop(&ev)) {
+			if(ev == INPUT_QUIT_EVENT) { exit(0); }
+		}
+		return;
 	}
 
-	SDL_Event event;
-	while(SDL_PollEvent(&event)) {
-		// If a key was pressed
+	if(timer_flag) {
+		device_input(INPUT_TIMER, 0);
+		timer_flag = false;
+	}
 
-		uint32_t sym = event.key.keysym.sym;
-		if( event.type == SDL_KEYDOWN ) {
-			keyboard_intr(sym2scancode[sym >> 8][sym & 0xff]);
-		}
-		else if( event.type == SDL_KEYUP ) {
-			keyboard_intr(sym2scancode[sym >> 8][sym & 0xff] | 0x80);
-		}
+	if(update_screen_flag) {
+		/* only publish the frame, the render thread draws it */
+		device_input(INPUT_SCREEN, 0);
+		update_screen_flag = false;
+	}
 
-		// If the user has Xed out the window
-		if( event.type == SDL_QUIT ) {
-			//Quit the program
-			exit(0);
-		}
+	while(input_pop(&ev)) {
+		device_input(ev == INPUT_QUIT_EVENT ? INPUT_QUIT : INPUT_KEY, ev);
 	}
 }
 
 void sdl_clear_event_queue() {
-	SDL_Event event;
-	while(SDL_PollEvent(&event));
+	uint16_t ev;
+	while(input_pop(&ev));
 }
 
-void init_sdl() {
+/* The render thread owns SDL: it sets up the video mode, presents the
+ * frames published by update_screen(), and polls the input events.
+ */
+static pthread_t render_thread;
+static pthread_mutex_t render_init_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t render_init_done = PTHREAD_COND_INITIALIZER;
+static bool render_ready = false;
+
+static void *render_loop(void *arg) {
 	int ret = SDL_Init(SDL_INIT_VIDEO | SDL_INIT_NOPARACHUTE);
 	Assert(ret == 0, "SDL_Init failed");
 
-	real_screen = SDL_SetVideoMode(640, 400, 8, 
-			SDL_HWSURFACE | SDL_HWPALETTE | SDL_HWACCEL | SDL_ASYNCBLIT);
-
-	screen = SDL_CreateRGBSurface(SDL_SWSURFACE, 640, 400, 8,
-			real_screen->format->Rmask, real_screen->format->Gmask,
-			real_screen->format->Bmask, real_screen->format->Amask);
-	pixel_buf = screen->pixels;
-
-	SDL_SetPalette(real_screen, SDL_LOGPAL | SDL_PHYSPAL, (void *)&palette, 0, 256);
-	SDL_SetPalette(screen, SDL_LOGPAL, (void *)&palette, 0, 256);
+	/* The guest palette is expanded by NEMU, see vga_present_frame(). */
+	real_screen = SDL_SetVideoMode(640, 400, 32, SDL_SWSURFACE);
+	Assert(real_screen && real_screen->pitch == SCREEN_COL * sizeof(uint32_t),
+			"SDL_SetVideoMode failed");
+	pixel_buf = real_screen->pixels;
 
 	SDL_WM_SetCaption("NEMU", NULL);
 
 	SDL_EnableKeyRepeat(SDL_DEFAULT_REPEAT_DELAY, SDL_DEFAULT_REPEAT_INTERVAL);
 
+	pthread_mutex_lock(&render_init_lock);
+	render_ready = true;
+	pthread_cond_signal(&render_init_done);
+	pthread_mutex_unlock(&render_init_lock);
+
+	while(1) {
+		/* wake up at least every 10ms to poll the input */
+		vga_present_frame(10);
+
+		SDL_Event event;
+		while(SDL_PollEvent(&event)) {
+			// If a key was pressed
+
+			uint32_t sym = event.key.keysym.sym;
+			if( event.type == SDL_KEYDOWN ) {
+				input_push(sym2scancode[sym >> 8][sym & 0xff]);
+			}
+			else if( event.type == SDL_KEYUP ) {
+				input_push(sym2scancode[sym >> 8][sym & 0xff] | 0x80);
+			}
+
+			// If the user has Xed out the window
+			if( event.type == SDL_QUIT ) {
+				//Quit the program from the CPU thread
+				input_push(INPUT_QUIT_EVENT);
+			}
+		}
+	}
+	return NULL;
+}
+
+void init_sdl() {
+	init_vga_scale();
+
+	/* The timer signal must be handled by the CPU thread,
+	 * so the render thread starts with it blocked.
+	 */
+	sigset_t set, old;
+	sigemptyset(&set);
+	sigaddset(&set, SIGVTALRM);
+	pthread_sigmask(SIG_BLOCK, &set, &old);
+	int ret = pthread_create(&render_thread, NULL, render_loop, NULL);
+	Assert(ret == 0, "Can not create the render thread");
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	pthread_mutex_lock(&render_init_lock);
+	while(!render_ready) {
+		pthread_cond_wait(&render_init_done, &render_init_lock);
+	}
+	pthread_mutex_unlock(&render_init_lock);
+
 	struct sigaction s;
 	memset(&s, 0, sizeof(s));
 	s.sa_handler = timer_sig_handler;
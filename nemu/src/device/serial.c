@@ -1,23 +1,121 @@
 #include "common.h"
 #include "device/port-io.h"
+#include "device/event.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
 
 /* http://en.wikibooks.org/wiki/Serial_Programming/8250_UART_Programming */
 
 #define SERIAL_PORT 0x3F8
 #define CH_OFFSET 0
+#define FCR_OFFSET 2		/* FIFO control register */
+#define LCR_OFFSET 3		/* line control register */
 #define LSR_OFFSET 5		/* line status register */
 
+#define LCR_DLAB 0x80
+#define FCR_CLEAR_TX 0x04
+#define LSR_THRE 0x20		/* transmit FIFO empty */
+#define LSR_TEMT 0x40		/* transmitter empty */
+
+/* 16550 transmit FIFO. The bytes written by the guest leave the FIFO
+ * together, SERIAL_TX_DELAY instructions after the first one, so the
+ * guest sees THRE clear while a burst is being sent.
+ */
+#define TX_FIFO_SIZE 16
+#define SERIAL_TX_DELAY 16
+
 static uint8_t *serial_port_base;
+static uint8_t tx_fifo[TX_FIFO_SIZE];
+static int tx_cnt;
+static bool tx_scheduled;
+
+/* The host side. Output is collected in a large buffer and written to
+ * the sink with a single write(), when the buffer is full, every
+ * SERIAL_FLUSH_INTERVAL instructions, and when the program stops.
+ */
+#define SINK_SIZE (64 * 1024)
+#define SERIAL_FLUSH_INTERVAL 1000000
+
+/* set by the command line options, NULL or "-" for stdout */
+const char *serial_sink = NULL;
+
+static int sink_fd = 1;
+static char sink_buf[SINK_SIZE];
+static int sink_len;
+
+static void write_sink() {
+	if(sink_len == 0) {
+		return;
+	}
+	if(sink_fd == 1) {
+		/* keep the order with the output of NEMU itself */
+		fflush(stdout);
+	}
+
+	int done = 0;
+	while(done < sink_len) {
+		ssize_t ret = write(sink_fd, sink_buf + done, sink_len - done);
+		if(ret <= 0) { break; }
+		done += ret;
+	}
+	sink_len = 0;
+}
+
+static void update_lsr() {
+	serial_port_base[LSR_OFFSET] = (tx_cnt == 0 ? LSR_THRE | LSR_TEMT : 0);
+}
+
+static void transmit(void *arg) {
+	tx_scheduled = false;
+	if(sink_len + tx_cnt > SINK_SIZE) {
+		write_sink();
+	}
+	memcpy(sink_buf + sink_len, tx_fifo, tx_cnt);
+	sink_len += tx_cnt;
+	tx_cnt = 0;
+	update_lsr();
+}
+
+/* Called when the program stops. The bytes still in the FIFO are sent
+ * at once, or the last message before a trap would be lost.
+ */
+void serial_flush() {
+	if(tx_cnt > 0) {
+		transmit(NULL);
+	}
+	write_sink();
+}
+
+static void periodic_flush(void *arg) {
+	write_sink();
+	add_event(SERIAL_FLUSH_INTERVAL, periodic_flush, NULL);
+}
 
 void serial_io_handler(ioaddr_t addr, size_t len, bool is_write) {
 	if(is_write) {
 		assert(len == 1);
+		if(serial_port_base[LCR_OFFSET] & LCR_DLAB) {
+			/* setting the divisor latch, nothing to send */
+			return;
+		}
+
 		if(addr == SERIAL_PORT + CH_OFFSET) {
-			char c = serial_port_base[CH_OFFSET];
-			/* We bind the serial port with the host stdout in NEMU. */
-			putc(c, stdout);
-			if(c == '\n') {
-				fflush(stdout);
+			/* The byte is lost if the FIFO is full, as on real hardware. */
+			if(tx_cnt < TX_FIFO_SIZE) {
+				tx_fifo[tx_cnt ++] = serial_port_base[CH_OFFSET];
+			}
+			if(!tx_scheduled) {
+				tx_scheduled = true;
+				add_event(SERIAL_TX_DELAY, transmit, NULL);
+			}
+			update_lsr();
+		}
+		else if(addr == SERIAL_PORT + FCR_OFFSET) {
+			if(serial_port_base[FCR_OFFSET] & FCR_CLEAR_TX) {
+				tx_cnt = 0;
+				update_lsr();
 			}
 		}
 	}
@@ -25,5 +123,33 @@ void serial_io_handler(ioaddr_t addr, size_t len, bool is_write) {
 
 void init_serial() {
 	serial_port_base = add_pio_map(SERIAL_PORT, 8, serial_io_handler);
-	serial_port_base[LSR_OFFSET] = 0x20; /* the status is always free */
+	tx_cnt = 0;
+	tx_scheduled = false;
+	update_lsr();
+
+	if(serial_sink != NULL && strcmp(serial_sink, "-") != 0) {
+		if(strncmp(serial_sink, "fd:", 3) == 0) {
+			sink_fd = atoi(serial_sink + 3);
+		}
+		else {
+			sink_fd = open(serial_sink, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			Assert(sink_fd >= 0, "Can not open '%s'", serial_sink);
+		}
+	}
+	sink_len = 0;
+
+	static bool registered = false;
+	if(!registered) {
+		atexit(serial_flush);
+		registered = true;
+	}
+	add_event(SERIAL_FLUSH_INTERVAL, periodic_flush, NULL);
+}
+
+/* The registers are saved with the ports. Only send what is in the FIFO,
+ * so that the saved state has it empty.
+ */
+void serial_save() {
+	transmit(NULL);
+	write_sink();
 }
@@ -0,0 +1,143 @@
+#include "common.h"
+
+/* Headless display. Instead of opening a window, the screen is captured
+ * every `capture_interval' instructions of virtual time, if it has changed,
+ * and written to `capture_file':
+ *   *.ppm   a stream of binary PPM images
+ *   *.y4m   a YUV4MPEG2 video (4:4:4)
+ *   others  raw 24-bit RGB frames
+ * If the file name contains a frame number conversion, "%d" or "%0Nd"
+ * (e.g. "frame%04d.ppm"), each frame is written to its own file instead.
+ * A hash of each frame is written to the log (to stdout with --batch,
+ * which has no log), so that the output of a program can be checked
+ * without looking at it.
+ */
+
+/* set by the command line options */
+const char *capture_file = NULL;
+uint32_t capture_interval = 100000;
+
+#ifdef HAS_DEVICE
+
+#include "vga.h"
+#include "device/event.h"
+
+#include <stdlib.h>
+#include <ctype.h>
+
+/* Without SDL, the timer interrupt is also driven by the virtual time. */
+#define TIMER_INTERVAL 10000
+
+enum { CAPTURE_RAW, CAPTURE_PPM, CAPTURE_Y4M };
+
+static int format;
+static bool numbered;
+static FILE *fp;
+static uint32_t nr_frame;
+static uint8_t frame[CTR_ROW][CTR_COL][3];
+
+/* FNV-1a */
+static uint64_t frame_hash() {
+	uint64_t h = 0xcbf29ce484222325ull;
+	uint8_t *p = (void *)frame;
+	int i;
+	for(i = 0; i < sizeof(frame); i ++) {
+		h = (h ^ p[i]) * 0x100000001b3ull;
+	}
+	return h;
+}
+
+static void write_y4m_frame() {
+	static uint8_t plane[3][CTR_ROW][CTR_COL];
+	int i, j;
+	for(i = 0; i < CTR_ROW; i ++) {
+		for(j = 0; j < CTR_COL; j ++) {
+			int r = frame[i][j][0], g = frame[i][j][1], b = frame[i][j][2];
+			plane[0][i][j] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+			plane[1][i][j] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+			plane[2][i][j] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+		}
+	}
+	fprintf(fp, "FRAME\n");
+	fwrite(plane, sizeof(plane), 1, fp);
+}
+
+static void write_frame() {
+	if(numbered) {
+		char name[256];
+		snprintf(name, sizeof(name), capture_file, (int)nr_frame);
+		fp = fopen(name, "wb");
+		Assert(fp, "Can not open '%s'", name);
+	}
+
+	switch(format) {
+		case CAPTURE_PPM:
+			fprintf(fp, "P6\n%d %d\n255\n", CTR_COL, CTR_ROW);
+			fwrite(frame, sizeof(frame), 1, fp);
+			break;
+		case CAPTURE_Y4M: write_y4m_frame(); break;
+		default: fwrite(frame, sizeof(frame), 1, fp); break;
+	}
+
+	if(numbered) { fclose(fp); }
+	else { fflush(fp); }
+}
+
+static void capture(void *arg) {
+	extern bool vga_capture_frame(uint8_t (*)[CTR_COL][3]);
+	if(vga_capture_frame(frame)) {
+		write_frame();
+		/* a batch run has no log */
+		FILE *out = (log_fp ? log_fp : stdout);
+		fprintf(out, "frame %u at %llu: %016llx\n", nr_frame,
+				(unsigned long long)nr_instr, (unsigned long long)frame_hash());
+		fflush(out);
+		nr_frame ++;
+	}
+
+	add_event(capture_interval, capture, NULL);
+}
+
+/* The file name is used as a printf format, so it must have exactly one
+ * conversion, "%d" or "%0Nd", and no other '%'.
+ */
+static bool check_numbered_name(const char *name) {
+	const char *p = strchr(name, '%');
+	if(p[1] == '0') {
+		for(p += 2; isdigit(*p); p ++);
+		if(!isdigit(p[-1])) { return false; }
+	}
+	else { p ++; }
+	return *p == 'd' && strchr(p, '%') == NULL;
+}
+
+static void timer_tick(void *arg) {
+	extern void timer_intr();
+	timer_intr();
+	add_event(TIMER_INTERVAL, timer_tick, NULL);
+}
+
+void init_capture() {
+	const char *ext = strrchr(capture_file, '.');
+	format = (ext && strcmp(ext, ".ppm") == 0 ? CAPTURE_PPM :
+			(ext && strcmp(ext, ".y4m") == 0 ? CAPTURE_Y4M : CAPTURE_RAW));
+	numbered = (strchr(capture_file, '%') != NULL);
+	Assert(!numbered || check_numbered_name(capture_file),
+			"'%s' must have one \"%%d\" or \"%%0Nd\" and no other '%%'", capture_file);
+	Assert(!(numbered && format == CAPTURE_Y4M), "Can not split a y4m video into files");
+	Assert(capture_interval > 0, "invalid capture interval");
+
+	if(!numbered) {
+		fp = fopen(capture_file, "wb");
+		Assert(fp, "Can not open '%s'", capture_file);
+		if(format == CAPTURE_Y4M) {
+			fprintf(fp, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", CTR_COL, CTR_ROW, VGA_HZ);
+		}
+	}
+	nr_frame = 0;
+
+	add_event(capture_interval, capture, NULL);
+	add_event(TIMER_INTERVAL, timer_tick, NULL);
+}
+
+#endif	/* HAS_DEVICE */
@@ -0,0 +1,78 @@
+#include "device/vga-scale.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/* Conversion kernels for screen refresh. They do not depend on SDL, so
+ * that they can be benchmarked on the host without a display.
+ */
+
+vga_expand_line_t vga_expand_line = vga_expand_line_scalar;
+
+void vga_expand_line_scalar(uint32_t *dst0, uint32_t *dst1,
+		const uint8_t *src, const uint32_t *pal, int n) {
+	int i;
+	for(i = 0; i < n; i ++) {
+		uint32_t c = pal[src[i]];
+		dst0[2 * i] = dst0[2 * i + 1] = c;
+		dst1[2 * i] = dst1[2 * i + 1] = c;
+	}
+}
+
+#ifdef __SSE2__
+/* SSE2 has no gather, so the palette lookup is scalar. The 2x scaling
+ * is done by duplicating the 32-bit lanes. */
+void vga_expand_line_sse2(uint32_t *dst0, uint32_t *dst1,
+		const uint8_t *src, const uint32_t *pal, int n) {
+	int i;
+	for(i = 0; i + 4 <= n; i += 4) {
+		__m128i c = _mm_set_epi32(pal[src[i + 3]], pal[src[i + 2]], pal[src[i + 1]], pal[src[i]]);
+		__m128i lo = _mm_unpacklo_epi32(c, c);
+		__m128i hi = _mm_unpackhi_epi32(c, c);
+		_mm_storeu_si128((void *)(dst0 + 2 * i), lo);
+		_mm_storeu_si128((void *)(dst0 + 2 * i + 4), hi);
+		_mm_storeu_si128((void *)(dst1 + 2 * i), lo);
+		_mm_storeu_si128((void *)(dst1 + 2 * i + 4), hi);
+	}
+	vga_expand_line_scalar(dst0 + 2 * i, dst1 + 2 * i, src + i, pal, n - i);
+}
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+/* AVX2 looks up 8 palette entries at once with a gather. */
+__attribute__((target("avx2")))
+void vga_expand_line_avx2(uint32_t *dst0, uint32_t *dst1,
+		const uint8_t *src, const uint32_t *pal, int n) {
+	const __m256i dup_lo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+	const __m256i dup_hi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+	int i;
+	for(i = 0; i + 8 <= n; i += 8) {
+		__m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const void *)(src + i)));
+		__m256i c = _mm256_i32gather_epi32((const int *)pal, idx, 4);
+		__m256i lo = _mm256_permutevar8x32_epi32(c, dup_lo);
+		__m256i hi = _mm256_permutevar8x32_epi32(c, dup_hi);
+		_mm256_storeu_si256((void *)(dst0 + 2 * i), lo);
+		_mm256_storeu_si256((void *)(dst0 + 2 * i + 8), hi);
+		_mm256_storeu_si256((void *)(dst1 + 2 * i), lo);
+		_mm256_storeu_si256((void *)(dst1 + 2 * i + 8), hi);
+	}
+	vga_expand_line_scalar(dst0 + 2 * i, dst1 + 2 * i, src + i, pal, n - i);
+}
+
+bool vga_scale_has_avx2() {
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+}
+#endif
+
+void init_vga_scale() {
+#ifdef __SSE2__
+	vga_expand_line = vga_expand_line_sse2;
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+	if(vga_scale_has_avx2()) {
+		vga_expand_line = vga_expand_line_avx2;
+	}
+#endif
+}
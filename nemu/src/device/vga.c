@@ -3,9 +3,16 @@
 #ifdef HAS_DEVICE
 
 #include "vga.h"
+#include "device/vga-scale.h"
 #include "device/port-io.h"
 #include "device/mmio.h"
 #include "device/i8259.h"
+#include "memory/memory.h"
+#include "memory/vmem-dirty.h"
+#include "monitor/savestate.h"
+
+#include <pthread.h>
+#include <time.h>
 
 enum {Horizontal_Total_Register, End_Horizontal_Display_Register, 
 	Start_Horizontal_Blanking_Register, End_Horizontal_Blanking_Register,
@@ -20,6 +27,7 @@ enum {Horizontal_Total_Register, End_Horizontal_Display_Register,
 };
 
 static uint8_t *vga_dac_port_base;
+static Color *palette_window;
 static uint8_t *vga_crtc_port_base;
 static uint8_t vga_crtc_regs[19];
 
@@ -30,53 +38,250 @@ static uint8_t vga_crtc_regs[19];
 #define VGA_CRTC_INDEX		0x3D4
 #define VGA_CRTC_DATA		0x3D5
 
-#define CTR_ROW 200
-#define CTR_COL 320
+/* Palette window. The 256 entries can be written here as {r, g, b, 0}
+ * with 8 bits per component, instead of 768 writes to the DAC data port.
+ */
+#define VGA_PALETTE_ADDR	0xc0000
+#define VGA_PALETTE_SIZE	(256 * 4)
 
 static void *vmem_base;
-bool vmem_dirty = false;
-bool line_dirty[CTR_ROW];
 
-void vga_vmem_io_handler(hwaddr_t addr, size_t len, bool is_write) {
-	if(is_write) {
-		int line = (addr - 0xa0000) / CTR_COL;
-		if(line < CTR_ROW) {
-			line_dirty[line] = true;
-			vmem_dirty = true;
+/* The offset of the displayed page in the 128KB window. It is set by
+ * the CRTC start address, which counts 4-byte units as in mode 13h,
+ * so that a guest can draw into one page and flip to it with two port
+ * writes.
+ */
+static uint32_t display_start = 0;
+
+/* The changed pixels [lo, hi) of a line, empty if lo >= hi. */
+typedef struct {
+	uint16_t lo, hi;
+} Span;
+
+static const Span full_span = { 0, CTR_COL };
+
+static inline void span_merge(Span *s, Span t) {
+	if(t.lo >= t.hi) { return; }
+	if(s->lo >= s->hi) { *s = t; return; }
+	if(t.lo < s->lo) { s->lo = t.lo; }
+	if(t.hi > s->hi) { s->hi = t.hi; }
+}
+
+/* set when every pixel may change */
+static bool redraw_all = true;
+static bool palette_dirty = true;
+
+/* Take the dirty chunks of the displayed page from the bitmap kept by
+ * the memory stack (see memory/vmem-dirty.h) and turn them into the
+ * spans of each line. Return whether anything on the screen has changed.
+ */
+static bool collect_dirty_spans(Span *span) {
+	if(palette_dirty) { redraw_all = true; }
+	if(!vmem_dirty && !redraw_all) {
+		return false;
+	}
+
+	int i, x;
+	bool changed = redraw_all;
+	for(i = 0; i < CTR_ROW; i ++) {
+		if(redraw_all) {
+			span[i] = full_span;
+			continue;
+		}
+
+		uint32_t off = (display_start + i * CTR_COL) & (VMEM_SIZE - 1);
+		uint32_t chunk = off >> VMEM_CHUNK_WIDTH;
+		span[i].lo = span[i].hi = 0;
+		for(x = -(off & (VMEM_CHUNK_SIZE - 1)); x < CTR_COL; x += VMEM_CHUNK_SIZE) {
+			if(vmem_is_dirty(chunk)) {
+				Span t = { (x < 0 ? 0 : x), (x + VMEM_CHUNK_SIZE > CTR_COL ? CTR_COL : x + VMEM_CHUNK_SIZE) };
+				span_merge(&span[i], t);
+				changed = true;
+			}
+			chunk = (chunk + 1) & (VMEM_NR_CHUNK - 1);
 		}
 	}
+
+	/* Writes to a hidden page are dropped here. They are drawn by
+	 * the redraw when the page is flipped to. */
+	memset(vmem_dirty_map, 0, sizeof(vmem_dirty_map));
+	vmem_dirty = false;
+	redraw_all = false;
+	return changed;
 }
 
-void do_update_screen_graphic_mode() {
-	int i, j;
-	uint8_t (*vmem) [CTR_COL] = vmem_base;
-	SDL_Rect rect;
-	rect.x = 0;
-	rect.w = CTR_COL * 2;
-	rect.h = 2;
+/* Return the line `i' of the displayed page. A line wrapping around
+ * the end of the window is copied into `buf'.
+ */
+static uint8_t *scanline(int i, uint8_t *buf) {
+	uint32_t off = (display_start + i * CTR_COL) & (VMEM_SIZE - 1);
+	if(off + CTR_COL <= VMEM_SIZE) {
+		return vmem_base + off;
+	}
+
+	uint32_t n = VMEM_SIZE - off;
+	memcpy(buf, vmem_base + off, n);
+	memcpy(buf + n, vmem_base, CTR_COL - n);
+	return buf;
+}
+
+void key_script_frame();
+
+/* The screen is presented by the render thread (see sdl.c). At each
+ * refresh the CPU thread copies the dirty spans and the palette into
+ * `pending', and the render thread takes them from there into `shown',
+ * so that neither thread waits for the other to draw.
+ */
+typedef struct {
+	uint8_t vmem[CTR_ROW][CTR_COL];
+	Span span[CTR_ROW];
+	Color palette[256];
+	bool palette_dirty;
+	bool ready;
+} Frame;
+
+static Frame pending, shown;
+static pthread_mutex_t frame_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t frame_ready = PTHREAD_COND_INITIALIZER;
+
+/* the palette in the pixel format of the host, used by the render thread */
+static uint32_t host_palette[256];
+
+static void update_host_palette() {
+	int i;
+	for(i = 0; i < 256; i ++) {
+		host_palette[i] = SDL_MapRGB(real_screen->format,
+				shown.palette[i].r, shown.palette[i].g, shown.palette[i].b);
+	}
+}
+
+static void do_update_screen_graphic_mode() {
+	int i;
+	int first = -1, last = -1;
+	Span box = { 0, 0 };
 
 	for(i = 0; i < CTR_ROW; i ++) {
-		if(line_dirty[i]) {
-			for(j = 0; j < CTR_COL; j ++) {
-				uint8_t color_idx = vmem[i][j];
-				draw_pixel(2 * j, 2 * i, color_idx);
-				draw_pixel(2 * j, 2 * i + 1, color_idx);
-				draw_pixel(2 * j + 1, 2 * i, color_idx);
-				draw_pixel(2 * j + 1, 2 * i + 1, color_idx);
-			}
-			rect.y = i * 2;
-			SDL_BlitSurface(screen, &rect, real_screen, &rect);
+		Span s = shown.span[i];
+		if(s.lo < s.hi) {
+			vga_expand_line(pixel_buf[2 * i] + 2 * s.lo, pixel_buf[2 * i + 1] + 2 * s.lo,
+					shown.vmem[i] + s.lo, host_palette, s.hi - s.lo);
+			span_merge(&box, s);
+			if(first == -1) { first = i; }
+			last = i;
 		}
 	}
-	SDL_Flip(real_screen);
+
+	/* one update over the bounding box of the dirty spans */
+	if(first != -1) {
+		SDL_UpdateRect(real_screen, 2 * box.lo, 2 * first, 2 * (box.hi - box.lo), 2 * (last - first + 1));
+	}
 }
 
+/* Called by the CPU thread at each refresh. */
 void update_screen() {
-	if(vmem_dirty) {
-		do_update_screen_graphic_mode();
-		vmem_dirty = false;
-		memset(line_dirty, false, CTR_ROW);
+	static Span span[CTR_ROW];
+	key_script_frame();
+	bool new_palette = palette_dirty;
+	if(!collect_dirty_spans(span)) {
+		return;
+	}
+
+	uint8_t buf[CTR_COL];
+	int i;
+
+	pthread_mutex_lock(&frame_lock);
+	/* The last frame may not be taken yet, so merge into it. */
+	if(new_palette) {
+		memcpy(pending.palette, palette, sizeof(pending.palette));
+		pending.palette_dirty = true;
+		palette_dirty = false;
+	}
+	for(i = 0; i < CTR_ROW; i ++) {
+		Span s = span[i];
+		if(s.lo < s.hi) {
+			memcpy(pending.vmem[i] + s.lo, scanline(i, buf) + s.lo, s.hi - s.lo);
+			span_merge(&pending.span[i], s);
+		}
+	}
+	pending.ready = true;
+	pthread_cond_signal(&frame_ready);
+	pthread_mutex_unlock(&frame_lock);
+}
+
+/* Called by the render thread. Wait at most `ms' milliseconds for
+ * a frame, and present it.
+ */
+void vga_present_frame(int ms) {
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += ms * 1000000L;
+	ts.tv_sec += ts.tv_nsec / 1000000000L;
+	ts.tv_nsec %= 1000000000L;
+
+	int i;
+	pthread_mutex_lock(&frame_lock);
+	while(!pending.ready) {
+		if(pthread_cond_timedwait(&frame_ready, &frame_lock, &ts) != 0) {
+			pthread_mutex_unlock(&frame_lock);
+			return;
+		}
+	}
+	if(pending.palette_dirty) {
+		memcpy(shown.palette, pending.palette, sizeof(shown.palette));
+		shown.palette_dirty = true;
+		pending.palette_dirty = false;
+	}
+	for(i = 0; i < CTR_ROW; i ++) {
+		Span s = pending.span[i];
+		if(s.lo < s.hi) {
+			memcpy(shown.vmem[i] + s.lo, pending.vmem[i] + s.lo, s.hi - s.lo);
+			shown.span[i] = s;
+			pending.span[i].lo = pending.span[i].hi = 0;
+		}
+		else {
+			shown.span[i].lo = shown.span[i].hi = 0;
+		}
 	}
+	pending.ready = false;
+	pthread_mutex_unlock(&frame_lock);
+
+	if(shown.palette_dirty) {
+		/* every pixel may change */
+		update_host_palette();
+		for(i = 0; i < CTR_ROW; i ++) { shown.span[i] = full_span; }
+		shown.palette_dirty = false;
+	}
+
+	do_update_screen_graphic_mode();
+}
+
+/* Used by the headless display instead of update_screen(). Convert the
+ * pixels changed since the last call into `rgb', and return whether
+ * anything has changed at all.
+ */
+bool vga_capture_frame(uint8_t (*rgb)[CTR_COL][3]) {
+	static Span span[CTR_ROW];
+	key_script_frame();
+	if(!collect_dirty_spans(span)) {
+		return false;
+	}
+	palette_dirty = false;
+
+	uint8_t buf[CTR_COL];
+	int i, j;
+	for(i = 0; i < CTR_ROW; i ++) {
+		if(span[i].lo < span[i].hi) {
+			uint8_t *line = scanline(i, buf);
+			for(j = span[i].lo; j < span[i].hi; j ++) {
+				Color c = palette[ line[j] ];
+				rgb[i][j][0] = c.r;
+				rgb[i][j][1] = c.g;
+				rgb[i][j][2] = c.b;
+			}
+		}
+	}
+
+	return true;
 }
 
 void vga_dac_io_handler(ioaddr_t addr, size_t len, bool is_write) {
@@ -86,28 +291,76 @@ void vga_dac_io_handler(ioaddr_t addr, size_t len, bool is_write) {
 	}
 	else if(addr == VGA_DAC_DATA && is_write) {
 		*color_ptr++ = vga_dac_port_base[1] << 2;
-		if( (((void *)color_ptr - (void *)&screen->format->palette->colors) & 0x3) == 3) {
+		if( (((void *)color_ptr - (void *)palette) & 0x3) == 3) {
 			color_ptr ++;
 			if((void *)color_ptr == (void *)&palette[256]) {
-				SDL_SetPalette(real_screen, SDL_LOGPAL | SDL_PHYSPAL, (void *)&palette, 0, 256);
-				SDL_SetPalette(screen, SDL_LOGPAL, (void *)&palette, 0, 256);
+				/* The screen is redrawn at the next refresh. */
+				palette_dirty = true;
+				memcpy(palette_window, palette, VGA_PALETTE_SIZE);
 			}
 		}
 	}
 }
 
+void vga_palette_io_handler(hwaddr_t addr, size_t len, bool is_write) {
+	if(is_write) {
+		int i;
+		for(i = (addr - VGA_PALETTE_ADDR) / 4; i <= (addr + len - 1 - VGA_PALETTE_ADDR) / 4; i ++) {
+			palette[i].val = palette_window[i].val;
+		}
+		/* The screen is redrawn at the next refresh, whatever number
+		 * of entries are written before it. */
+		palette_dirty = true;
+	}
+}
+
 void vga_crtc_io_handler(ioaddr_t addr, size_t len, bool is_write) {
 	if(addr == VGA_CRTC_INDEX && is_write) {
 		vga_crtc_port_base[1] = vga_crtc_regs[ vga_crtc_port_base[0] ];
 	}
 	else if(addr == VGA_CRTC_DATA && is_write) {
 		vga_crtc_regs[ vga_crtc_port_base[0] ] = vga_crtc_port_base[1] ;
+		if(vga_crtc_port_base[0] == Start_Address_High_Register ||
+				vga_crtc_port_base[0] == Start_Address_Low_Register) {
+			/* page flip, the whole screen changes */
+			display_start = ((vga_crtc_regs[Start_Address_High_Register] << 8 |
+					vga_crtc_regs[Start_Address_Low_Register]) << 2) & (VMEM_SIZE - 1);
+			redraw_all = true;
+		}
 	}
 }
 
+typedef struct {
+	Color palette[256];
+	uint8_t crtc_regs[sizeof(vga_crtc_regs)];
+} VGA_state;
+
+/* The video memory is saved with the physical memory. */
+void vga_save() {
+	VGA_state s;
+	memcpy(s.palette, palette, sizeof(s.palette));
+	memcpy(s.crtc_regs, vga_crtc_regs, sizeof(s.crtc_regs));
+	savestate_put("VGA ", &s, sizeof(s));
+}
+
+void vga_load() {
+	VGA_state s;
+	savestate_get_copy("VGA ", &s, sizeof(s));
+	memcpy(palette, s.palette, sizeof(s.palette));
+	memcpy(vga_crtc_regs, s.crtc_regs, sizeof(s.crtc_regs));
+	display_start = ((vga_crtc_regs[Start_Address_High_Register] << 8 |
+			vga_crtc_regs[Start_Address_Low_Register]) << 2) & (VMEM_SIZE - 1);
+	palette_dirty = true;
+	redraw_all = true;
+}
+
 void init_vga() {
 	vga_dac_port_base = add_pio_map(VGA_DAC_WRITE_INDEX, 2, vga_dac_io_handler);
 	vga_crtc_port_base = add_pio_map(VGA_CRTC_INDEX, 2, vga_crtc_io_handler);
-	vmem_base = add_mmio_map(0xa0000, 0x20000, vga_vmem_io_handler);
+	/* The video memory is in the physical memory, and its dirty
+	 * chunks are tracked by the memory stack. */
+	vmem_base = hwa_to_va(VMEM_ADDR);
+	palette_window = add_mmio_map(VGA_PALETTE_ADDR, VGA_PALETTE_SIZE, vga_palette_io_handler);
+	memcpy(palette_window, palette, VGA_PALETTE_SIZE);
 }
 #endif	/* HAS_DEVICE */
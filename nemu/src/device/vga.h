@@ -8,15 +8,14 @@
 #define SCREEN_COL 640
 #define VGA_HZ 25
 
-extern SDL_Surface *real_screen;
-extern SDL_Surface *screen;
+/* the resolution of the guest mode 13h */
+#define CTR_ROW 200
+#define CTR_COL 320
 
-extern uint8_t (*pixel_buf) [SCREEN_COL];
+extern SDL_Surface *real_screen;
 
-static inline void draw_pixel(int x, int y, uint8_t color_idx) {
-	assert(x >= 0 && x < SCREEN_COL && y >= 0 && y < SCREEN_ROW);
-	pixel_buf[y][x] = color_idx;
-}
+/* the 32-bit pixels of the screen */
+extern uint32_t (*pixel_buf) [SCREEN_COL];
 
 typedef union {
 	uint32_t val;
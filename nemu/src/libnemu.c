@@ -0,0 +1,155 @@
+#include "nemu.h"
+#include "libnemu.h"
+#include "monitor/monitor.h"
+#include "monitor/savestate.h"
+#include "monitor/checkpoint.h"
+#include "memory/vmem-dirty.h"
+#include "cpu/ifetch.h"
+
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+struct nemu_machine {
+	pthread_t owner;
+	double run_time;
+};
+
+extern char *exec_file;
+extern bool elf_boot;
+
+void load_elf_tables(int, char *[]);
+void init_machine(uint32_t);
+void free_dram();
+void init_ddr3();
+void restart();
+void cpu_exec(uint32_t);
+
+/* The ELF tables and the boot options are shared by the machines. */
+static pthread_mutex_t create_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void check_owner(nemu_machine *m) {
+	Assert(pthread_equal(m->owner, pthread_self()),
+			"a machine can only be used by the thread which creates it");
+}
+
+nemu_machine *nemu_create(const char *image, uint32_t mem_mb, int flags) {
+	Assert(hw_mem == NULL, "this thread already has a machine");
+	Assert(mem_mb <= 2048, "invalid memory size %u MB", mem_mb);
+	Assert(mem_mb == 0 || mem_mb << 20 >= MIN_BOOT_MEM_SIZE || (flags & NEMU_ELF_BOOT),
+			"%u MB of memory is too small for the stack of the program, use NEMU_ELF_BOOT", mem_mb);
+
+	nemu_machine *m = malloc(sizeof(*m));
+	assert(m);
+	m->owner = pthread_self();
+	m->run_time = 0;
+
+	pthread_mutex_lock(&create_lock);
+	if(exec_file == NULL || strcmp(exec_file, image) != 0) {
+		char *argv[] = { "nemu", strdup(image) };
+		load_elf_tables(2, argv);
+	}
+	elf_boot = (flags & NEMU_ELF_BOOT) != 0;
+	init_machine(mem_mb ? mem_mb << 20 : HW_MEM_SIZE_DEFAULT);
+	restart();
+	pthread_mutex_unlock(&create_lock);
+
+	return m;
+}
+
+void nemu_destroy(nemu_machine *m) {
+	check_owner(m);
+	free_dram();
+	memset(&cpu, 0, sizeof(cpu));
+	nemu_state = STOP;
+	nr_instr = 0;
+	ifb.nr_fetch = ifb.nr_bus_read = 0;
+	free(m);
+}
+
+int nemu_run(nemu_machine *m, uint64_t n) {
+	check_owner(m);
+	double start = now();
+	while(n > 0 && nemu_state != END) {
+		uint32_t k = (n > 0xffffffffu ? 0xffffffffu : n);
+		uint64_t before = nr_instr;
+		cpu_exec(k);
+		uint64_t done = nr_instr - before;
+		n = (n == NEMU_RUN_TO_END ? n : n - done);
+		if(nemu_state == STOP && done < k) {
+			/* a breakpoint */
+			break;
+		}
+	}
+	m->run_time += now() - start;
+	return nemu_state == END ? NEMU_ENDED : NEMU_STOPPED;
+}
+
+uint32_t nemu_get_reg(nemu_machine *m, int reg) {
+	check_owner(m);
+	Assert(reg >= NEMU_EAX && reg <= NEMU_EIP, "invalid register %d", reg);
+	return (reg == NEMU_EIP ? cpu.eip : reg_l(reg));
+}
+
+void nemu_set_reg(nemu_machine *m, int reg, uint32_t val) {
+	check_owner(m);
+	Assert(reg >= NEMU_EAX && reg <= NEMU_EIP, "invalid register %d", reg);
+	if(reg == NEMU_EIP) {
+		cpu.eip = val;
+		ifb_flush();
+	}
+	else {
+		reg_l(reg) = val;
+	}
+}
+
+void nemu_read_mem(nemu_machine *m, uint32_t addr, void *buf, size_t len) {
+	check_owner(m);
+	Assert((uint64_t)addr + len <= hw_mem_size, "[0x%x, 0x%llx) is out of the physical memory",
+			addr, (unsigned long long)addr + len);
+	memcpy(buf, hwa_to_va(addr), len);
+}
+
+void nemu_write_mem(nemu_machine *m, uint32_t addr, const void *buf, size_t len) {
+	check_owner(m);
+	Assert((uint64_t)addr + len <= hw_mem_size, "[0x%x, 0x%llx) is out of the physical memory",
+			addr, (unsigned long long)addr + len);
+	if(len == 0) {
+		return;
+	}
+	/* as a DMA transfer does */
+	checkpoint_check_write(addr, len);
+	memcpy(hwa_to_va(addr), buf, len);
+	vmem_check_write(addr, len);
+	ifb_flush();
+	init_ddr3();
+}
+
+int nemu_save(nemu_machine *m, const char *path) {
+	check_owner(m);
+	return save_state(path) ? 0 : -1;
+}
+
+void nemu_load(nemu_machine *m, const char *path) {
+	check_owner(m);
+	load_state(path);
+	if(nemu_state == END) {
+		nemu_state = STOP;
+	}
+}
+
+void nemu_get_stats(nemu_machine *m, nemu_stats *s) {
+	check_owner(m);
+	s->instructions = nr_instr;
+	s->instr_fetches = ifb.nr_fetch;
+	s->bus_reads = ifb.nr_bus_read;
+	s->run_time = m->run_time;
+	s->ended = (nemu_state == END);
+	s->exit_code = cpu.eax;
+}
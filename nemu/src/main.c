@@ -1,7 +1,12 @@
+#include "common.h"
+
 void init_monitor(int, char *[]);
 void reg_test();
 void restart();
 void ui_mainloop();
+int batch_run();
+
+extern bool batch_mode;
 
 int main(int argc, char *argv[]) {
 
@@ -14,6 +19,11 @@ int main(int argc, char *argv[]) {
 	/* Initialize the virtual computer system. */
 	restart();
 
+	/* Run to the end with --batch. */
+	if(batch_mode) {
+		return batch_run();
+	}
+
 	/* Receive commands from user. */
 	ui_mainloop();
 
@@ -2,6 +2,10 @@
 #include "burst.h"
 #include "misc.h"
 
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 /* Simulate the (main) behavor of DRAM.
  * Although this will lower the performace of NEMU, it makes
  * you clear about how DRAM perform read/write operations.
@@ -11,7 +15,7 @@
 #define COL_WIDTH 10
 #define ROW_WIDTH 10
 #define BANK_WIDTH 3
-#define RANK_WIDTH (27 - COL_WIDTH - ROW_WIDTH - BANK_WIDTH)
+#define RANK_WIDTH (32 - COL_WIDTH - ROW_WIDTH - BANK_WIDTH)
 
 typedef union {
 	struct {
@@ -27,12 +31,24 @@ typedef union {
 #define NR_COL (1 << COL_WIDTH)
 #define NR_ROW (1 << ROW_WIDTH)
 #define NR_BANK (1 << BANK_WIDTH)
-#define NR_RANK (1 << RANK_WIDTH)
+#define RANK_SIZE (1 << (COL_WIDTH + ROW_WIDTH + BANK_WIDTH))
+
+#define PAGE_WIDTH 12
+#define PAGE_SIZE (1 << PAGE_WIDTH)
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* The physical memory is an anonymous mapping of the host. Pages are
+ * committed lazily (zero-filled) by the host kernel when they are first
+ * touched, so a small guest does not pay for the whole memory.
+ */
+machine_local uint8_t *hw_mem = NULL;
+machine_local uint32_t hw_mem_size = 0;
+static machine_local int nr_rank;
 
-#define HW_MEM_SIZE (1 << (COL_WIDTH + ROW_WIDTH + BANK_WIDTH + RANK_WIDTH))
+/* pages written by the guest, one bit per page */
+static machine_local uint8_t *page_touched;
 
-uint8_t dram[NR_RANK][NR_BANK][NR_ROW][NR_COL];
-uint8_t *hw_mem = (void *)dram;
+#define dram_row(addr) (hw_mem + ((addr) & ~(NR_COL - 1)))
 
 typedef struct {
 	uint8_t buf[NR_COL];
@@ -40,19 +56,87 @@ typedef struct {
 	bool valid;
 } RB;
 
-RB rowbufs[NR_RANK][NR_BANK];
+static machine_local RB (*rowbufs)[NR_BANK];
+
+void init_dram(uint32_t size) {
+	Assert(size >= RANK_SIZE, "physical memory size(0x%x) is too small", size);
+
+	/* round up to a whole rank */
+	nr_rank = (size + RANK_SIZE - 1) / RANK_SIZE;
+	Assert(nr_rank <= (1 << RANK_WIDTH) / 2, "physical memory size(0x%x) is too large", size);
+	hw_mem_size = (uint32_t)nr_rank * RANK_SIZE;
+
+	/* Reserve one more huge page to align the memory to a huge page boundary. */
+	size_t map_size = hw_mem_size + HUGE_PAGE_SIZE;
+	uint8_t *p = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	Assert(p != MAP_FAILED, "Can not allocate physical memory of size 0x%x", hw_mem_size);
+
+	hw_mem = (void *)(((uintptr_t)p + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+	size_t head = hw_mem - p;
+	if(head != 0) { munmap(p, head); }
+	munmap(hw_mem + hw_mem_size, HUGE_PAGE_SIZE - head);
+
+#ifdef MADV_HUGEPAGE
+	/* Fewer host TLB misses for large guests. It is only a hint. */
+	madvise(hw_mem, hw_mem_size, MADV_HUGEPAGE);
+#endif
+
+	rowbufs = malloc(sizeof(rowbufs[0]) * nr_rank);
+	assert(rowbufs);
+	page_touched = calloc((hw_mem_size >> PAGE_WIDTH) / 8, 1);
+	assert(page_touched);
+}
+
+void free_dram() {
+	munmap(hw_mem, hw_mem_size);
+	free(rowbufs);
+	free(page_touched);
+	hw_mem = NULL;
+	hw_mem_size = 0;
+}
 
 void init_ddr3() {
 	int i, j;
-	for(i = 0; i < NR_RANK; i ++) {
+	for(i = 0; i < nr_rank; i ++) {
 		for(j = 0; j < NR_BANK; j ++) {
 			rowbufs[i][j].valid = false;
 		}
 	}
 }
 
+static inline void mark_page_touched(hwaddr_t addr) {
+	uint32_t page = addr >> PAGE_WIDTH;
+	page_touched[page >> 3] |= 1 << (page & 7);
+}
+
+/* Show how much of the physical memory is actually used. */
+void dram_info() {
+	uint32_t nr_page = hw_mem_size >> PAGE_WIDTH;
+	uint32_t i, nr_touched = 0, nr_resident = 0;
+	for(i = 0; i < nr_page / 8; i ++) {
+		nr_touched += __builtin_popcount(page_touched[i]);
+	}
+
+	long host_page_size = sysconf(_SC_PAGESIZE);
+	size_t nr_host_page = hw_mem_size / host_page_size;
+	unsigned char *vec = malloc(nr_host_page);
+	if(vec != NULL && mincore(hw_mem, hw_mem_size, vec) == 0) {
+		size_t k;
+		for(k = 0; k < nr_host_page; k ++) {
+			nr_resident += vec[k] & 1;
+		}
+		nr_resident = (uint64_t)nr_resident * host_page_size >> PAGE_WIDTH;
+	}
+	free(vec);
+
+	printf("physical memory\t%u KB (%u pages)\n", hw_mem_size >> 10, nr_page);
+	printf("written by guest\t%u pages (%u KB)\n", nr_touched, nr_touched << (PAGE_WIDTH - 10));
+	printf("resident in host\t%u pages (%u KB)\n", nr_resident, nr_resident << (PAGE_WIDTH - 10));
+}
+
 static void ddr3_read(hwaddr_t addr, void *data) {
-	Assert(addr < HW_MEM_SIZE, "physical address %x is outside of the physical memory!", addr);
+	Assert(addr < hw_mem_size, "physical address %x is outside of the physical memory!", addr);
 
 	dram_addr temp;
 	temp.addr = addr & ~BURST_MASK;
@@ -63,7 +147,7 @@ static void ddr3_read(hwaddr_t addr, void *data) {
 
 	if(!(rowbufs[rank][bank].valid && rowbufs[rank][bank].row_idx == row) ) {
 		/* read a row into row buffer */
-		memcpy(rowbufs[rank][bank].buf, dram[rank][bank][row], NR_COL);
+		memcpy(rowbufs[rank][bank].buf, dram_row(temp.addr), NR_COL);
 		rowbufs[rank][bank].row_idx = row;
 		rowbufs[rank][bank].valid = true;
 	}
@@ -73,7 +157,7 @@ static void ddr3_read(hwaddr_t addr, void *data) {
 }
 
 static void ddr3_write(hwaddr_t addr, void *data, uint8_t *mask) {
-	Assert(addr < HW_MEM_SIZE, "physical address %x is outside of the physical memory!", addr);
+	Assert(addr < hw_mem_size, "physical address %x is outside of the physical memory!", addr);
 
 	dram_addr temp;
 	temp.addr = addr & ~BURST_MASK;
@@ -84,7 +168,7 @@ static void ddr3_write(hwaddr_t addr, void *data, uint8_t *mask) {
 
 	if(!(rowbufs[rank][bank].valid && rowbufs[rank][bank].row_idx == row) ) {
 		/* read a row into row buffer */
-		memcpy(rowbufs[rank][bank].buf, dram[rank][bank][row], NR_COL);
+		memcpy(rowbufs[rank][bank].buf, dram_row(temp.addr), NR_COL);
 		rowbufs[rank][bank].row_idx = row;
 		rowbufs[rank][bank].valid = true;
 	}
@@ -93,7 +177,8 @@ static void ddr3_write(hwaddr_t addr, void *data, uint8_t *mask) {
 	memcpy_with_mask(rowbufs[rank][bank].buf + col, data, BURST_LEN, mask);
 
 	/* write back to dram */
-	memcpy(dram[rank][bank][row], rowbufs[rank][bank].buf, NR_COL);
+	memcpy(dram_row(temp.addr), rowbufs[rank][bank].buf, NR_COL);
+	mark_page_touched(temp.addr);
 }
 
 uint32_t dram_read(hwaddr_t addr, size_t len) {
@@ -1,15 +1,36 @@
 #include "common.h"
+#include "cpu/ifetch.h"
+#include "memory/vmem-dirty.h"
+#include "monitor/checkpoint.h"
+#include "device/mmio.h"
 
 uint32_t dram_read(hwaddr_t, size_t);
 void dram_write(hwaddr_t, size_t, uint32_t);
 
+machine_local uint32_t vmem_dirty_map[VMEM_NR_CHUNK / 32];
+machine_local bool vmem_dirty = false;
+
 /* Memory accessing interfaces */
 
+/* The MMIO regions (e.g. the palette window of VGA) are taken by their
+ * devices, everything else goes to the DRAM.
+ */
 uint32_t hwaddr_read(hwaddr_t addr, size_t len) {
+	int map_NO = is_mmio(addr);
+	if(map_NO != -1) {
+		return mmio_read(addr, len, map_NO);
+	}
 	return dram_read(addr, len) & (~0u >> ((4 - len) << 3));
 }
 
 void hwaddr_write(hwaddr_t addr, size_t len, uint32_t data) {
+	int map_NO = is_mmio(addr);
+	if(map_NO != -1) {
+		mmio_write(addr, len, data, map_NO);
+		return;
+	}
+	vmem_check_write(addr, len);
+	checkpoint_check_write(addr, len);
 	dram_write(addr, len, data);
 }
 
@@ -32,6 +53,7 @@ void swaddr_write(swaddr_t addr, size_t len, uint32_t data) {
 #ifdef DEBUG
 	assert(len == 1 || len == 2 || len == 4);
 #endif
+	ifb_check_write(addr, len);
 	lnaddr_write(addr, len, data);
 }
 
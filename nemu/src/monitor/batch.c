@@ -0,0 +1,57 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+
+#include <time.h>
+#include <sys/resource.h>
+
+/* Non-interactive runs (--batch). The program runs to its trap, and one
+ * line of JSON on stdout reports the run:
+ *   {"program":"obj/testcase/mov","status":"good","exit_code":0,
+ *    "instructions":128,"wall_time":0.000052,"mips":2.46,"max_rss_kb":3412}
+ * The exit status of NEMU is 0 for HIT GOOD TRAP and 1 otherwise. With
+ * --max-instr, a program still running at the limit is stopped with the
+ * status "limit" and the exit status 2, for smoke runs of programs which
+ * never end.
+ */
+
+extern machine_local uint64_t nr_instr;
+extern char *exec_file;
+
+/* set by the command line options, 0 for no limit */
+uint64_t batch_max_instr = 0;
+
+void cpu_exec(uint32_t);
+void init_replay();
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int batch_run() {
+	init_replay();
+
+	uint64_t start_instr = nr_instr;
+	double start = now();
+	uint64_t end = (batch_max_instr ? start_instr + batch_max_instr : -1ull);
+	while(nemu_state != END && nr_instr < end) {
+		/* a breakpoint only stops the CPU for the monitor */
+		uint64_t left = end - nr_instr;
+		cpu_exec(left > 0xffffffffu ? 0xffffffffu : left);
+	}
+	double wall_time = now() - start;
+	uint64_t n = nr_instr - start_instr;
+
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+
+	int ret = (nemu_state != END ? 2 : cpu.eax == 0 ? 0 : 1);
+	const char *status[] = { "good", "bad", "limit" };
+	printf("{\"program\":\"%s\",\"status\":\"%s\",\"exit_code\":%u,"
+			"\"instructions\":%llu,\"wall_time\":%.6f,\"mips\":%.2f,\"max_rss_kb\":%ld}\n",
+			exec_file, status[ret], cpu.eax, (unsigned long long)n,
+			wall_time, wall_time > 0 ? n / wall_time / 1e6 : 0.0, ru.ru_maxrss);
+	fflush(stdout);
+	return ret;
+}
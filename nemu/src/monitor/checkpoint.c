@@ -0,0 +1,252 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/checkpoint.h"
+#include "monitor/watchpoint.h"
+#include "monitor/savestate.h"
+#include "memory/vmem-dirty.h"
+#include "device/event.h"
+#include "cpu/ifetch.h"
+
+#include <stdlib.h>
+
+/* Only the latest NR_CHECKPOINT checkpoints are kept, so reverse
+ * execution can go back NR_CHECKPOINT * checkpoint_interval instructions.
+ * Re-execution gives the same run as long as the devices are driven by
+ * the virtual time: without a window (--capture), the display and the
+ * timer are. What the devices output while re-executing (the serial
+ * port, captured frames) is output again, and the disk is not rolled
+ * back.
+ */
+#define NR_CHECKPOINT 64
+
+typedef struct {
+	uint32_t page;
+	uint8_t data[CKPT_PAGE_SIZE];
+} SavedPage;
+
+typedef struct {
+	uint64_t time;
+	CPU_state cpu;
+	void *devices, *events;
+	size_t devices_len;
+
+	/* the pages written after the checkpoint, as they were at it */
+	SavedPage **undo;
+	int nr_undo, max_undo;
+} Checkpoint;
+
+static machine_local Checkpoint ring[NR_CHECKPOINT];
+static machine_local int first, nr;
+
+/* set by the command line options, 0 for no checkpoints */
+uint32_t checkpoint_interval = 0;
+
+machine_local uint64_t next_checkpoint = -1ull;
+machine_local uint32_t *ckpt_page_saved = NULL;
+static machine_local size_t page_saved_size;
+
+extern machine_local bool replaying;
+extern machine_local uint64_t last_stop;
+void cpu_exec(uint32_t);
+void init_ddr3();
+
+#define at(i) (&ring[(first + (i)) % NR_CHECKPOINT])
+
+static void drop_undo(Checkpoint *c) {
+	int i;
+	for(i = 0; i < c->nr_undo; i ++) {
+		free(c->undo[i]);
+	}
+	c->nr_undo = 0;
+}
+
+static void drop(Checkpoint *c) {
+	drop_undo(c);
+	free(c->devices);
+	free(c->events);
+	c->devices = c->events = NULL;
+}
+
+void checkpoint_save_page(uint32_t page) {
+	ckpt_page_saved[page >> 5] |= 1u << (page & 31);
+
+	Checkpoint *c = at(nr - 1);
+	if(c->nr_undo == c->max_undo) {
+		c->max_undo = (c->max_undo ? c->max_undo * 2 : 64);
+		c->undo = realloc(c->undo, c->max_undo * sizeof(c->undo[0]));
+		assert(c->undo);
+	}
+	SavedPage *p = malloc(sizeof(SavedPage));
+	assert(p);
+	p->page = page;
+	memcpy(p->data, hw_mem + ((size_t)page << CKPT_PAGE_WIDTH), CKPT_PAGE_SIZE);
+	c->undo[c->nr_undo ++] = p;
+}
+
+void checkpoint_take() {
+#ifdef HAS_DEVICE
+	bool devices_quiescent();
+	if(!devices_quiescent()) {
+		/* wait for the DMA transfer */
+		next_checkpoint = nr_instr + 1;
+		return;
+	}
+#endif
+
+	if(nr == NR_CHECKPOINT) {
+		drop(at(0));
+		first = (first + 1) % NR_CHECKPOINT;
+		nr --;
+	}
+
+	Checkpoint *c = at(nr);
+	nr ++;
+	c->time = nr_instr;
+	c->cpu = cpu;
+#ifdef HAS_DEVICE
+	c->devices = save_devices_mem(&c->devices_len);
+	c->events = event_save();
+#endif
+	memset(ckpt_page_saved, 0, page_saved_size);
+
+	next_checkpoint = nr_instr + checkpoint_interval;
+}
+
+/* Go back to the i-th checkpoint, and drop the later ones. */
+static void rollback(int i) {
+	int j, k;
+	for(j = nr - 1; j >= i; j --) {
+		Checkpoint *c = at(j);
+		for(k = 0; k < c->nr_undo; k ++) {
+			SavedPage *p = c->undo[k];
+			memcpy(hw_mem + ((size_t)p->page << CKPT_PAGE_WIDTH), p->data, CKPT_PAGE_SIZE);
+		}
+		if(j > i) { drop(c); }
+	}
+	nr = i + 1;
+
+	Checkpoint *c = at(i);
+	drop_undo(c);
+	memset(ckpt_page_saved, 0, page_saved_size);
+
+	cpu = c->cpu;
+	nr_instr = c->time;
+#ifdef HAS_DEVICE
+	load_devices_mem(c->devices, c->devices_len);
+	/* after the devices, which may add events when loaded */
+	event_load(c->events);
+#endif
+	next_checkpoint = c->time + checkpoint_interval;
+
+	ifb_flush();
+	init_ddr3();
+	memset(vmem_dirty_map, 0xff, sizeof(vmem_dirty_map));
+	vmem_dirty = true;
+	nemu_state = STOP;
+}
+
+/* Re-execute to the given instruction, not stopping at breakpoints or watchpoints. */
+static void run_to(uint64_t target) {
+	replaying = true;
+	wp_enable(false);
+	while(nr_instr < target && nemu_state != END) {
+		uint64_t n = target - nr_instr;
+		cpu_exec(n > 0xffffffffu ? 0xffffffffu : n);
+	}
+	wp_enable(true);
+	wp_resync();
+	replaying = false;
+}
+
+/* The latest checkpoint not after the given instruction. */
+static int find(uint64_t time) {
+	int i;
+	for(i = nr - 1; i > 0 && at(i)->time > time; i --);
+	return i;
+}
+
+static bool enabled() {
+	if(nr == 0) {
+		printf("Reverse execution needs checkpoints, run with --checkpoint-interval=N\n");
+		return false;
+	}
+	return true;
+}
+
+static void print_position() {
+	printf("At instruction %llu, eip = 0x%08x\n", (unsigned long long)nr_instr, cpu.eip);
+}
+
+void reverse_step(uint64_t n) {
+	if(!enabled()) { return; }
+
+	uint64_t target = (n < nr_instr ? nr_instr - n : 0);
+	if(target < at(0)->time) {
+		printf("Can only go back to instruction %llu\n", (unsigned long long)at(0)->time);
+		target = at(0)->time;
+	}
+
+	rollback(find(target));
+	run_to(target);
+	print_position();
+}
+
+/* Search the checkpoints backwards, re-executing from each one to the
+ * next, for the last stop before the current instruction. Then go to
+ * the instruction before it, and execute it as usual, so that the
+ * breakpoint or the watchpoint reports itself.
+ */
+void reverse_continue() {
+	if(!enabled()) { return; }
+
+	uint64_t now = nr_instr, end[NR_CHECKPOINT];
+	int i, n = nr;
+	for(i = 0; i < n; i ++) {
+		end[i] = (i + 1 < n && at(i + 1)->time < now ? at(i + 1)->time : now - 1);
+	}
+
+	for(i = n - 1; i >= 0; i --) {
+		if(at(i)->time >= now) { continue; }
+
+		rollback(i);
+		replaying = true;
+		wp_resync();
+		last_stop = 0;
+		while(nr_instr < end[i] && nemu_state != END) {
+			cpu_exec(end[i] - nr_instr);
+		}
+		replaying = false;
+
+		/* every stop is after the checkpoint, so it is not 0 */
+		uint64_t stop = last_stop;
+		if(stop != 0) {
+			rollback(i);
+			run_to(stop - 1);
+			cpu_exec(1);
+			print_position();
+			return;
+		}
+	}
+
+	rollback(0);
+	printf("No breakpoint or watchpoint is hit since the oldest checkpoint\n");
+	print_position();
+}
+
+void init_checkpoint() {
+	if(checkpoint_interval == 0) {
+		return;
+	}
+#ifdef HAS_DEVICE
+	extern const char *capture_file;
+	if(capture_file == NULL) {
+		printf("Reverse execution needs the headless display (--capture), checkpoints are off\n");
+		return;
+	}
+#endif
+
+	page_saved_size = ((hw_mem_size >> CKPT_PAGE_WIDTH) + 31) / 32 * sizeof(uint32_t);
+	ckpt_page_saved = calloc(page_saved_size, 1);
+	assert(ckpt_page_saved);
+	checkpoint_take();
+}
@@ -1,6 +1,8 @@
 #include "monitor/monitor.h"
 #include "monitor/watchpoint.h"
 #include "cpu/helper.h"
+#include "device/event.h"
+#include "monitor/checkpoint.h"
 #include <setjmp.h>
 
 /* The assembly code of instructions executed is only output to the screen
@@ -10,28 +12,37 @@
  */
 #define MAX_INSTR_TO_PRINT 10
 
-int nemu_state = STOP;
+machine_local int nemu_state = STOP;
+
+/* number of instructions retired since NEMU starts */
+machine_local uint64_t nr_instr = 0;
+
+/* set while re-executing for reverse execution, which is not shown */
+machine_local bool replaying = false;
+
+/* the instruction count at the latest breakpoint or watchpoint hit */
+machine_local uint64_t last_stop = 0;
 
 int exec(swaddr_t);
 
-char assembly[80];
-char asm_buf[128];
+machine_local char assembly[80];
+machine_local char asm_buf[128];
 
 /* Used with exception handling. */
-jmp_buf jbuf;
+machine_local jmp_buf jbuf;
 
 void print_bin_instr(swaddr_t eip, int len) {
 	int i;
 	int l = sprintf(asm_buf, "%8x:   ", eip);
 	for(i = 0; i < len; i ++) {
-		l += sprintf(asm_buf + l, "%02x ", instr_fetch(eip + i, 1));
+		l += sprintf(asm_buf + l, "%02x ", swaddr_read(eip + i, 1));
 	}
 	sprintf(asm_buf + l, "%*.s", 50 - (12 + 3 * len), "");
 }
 
 /* This function will be called when an `int3' instruction is being executed. */
 void do_int3() {
-	printf("\nHit breakpoint at eip = 0x%08x\n", cpu.eip);
+	if(!replaying) printf("\nHit breakpoint at eip = 0x%08x\n", cpu.eip);
 	nemu_state = STOP;
 }
 
@@ -53,8 +64,8 @@ void cpu_exec(volatile uint32_t n) {
 	for(; n > 0; n --) {
 #ifdef DEBUG
 		swaddr_t eip_temp = cpu.eip;
-		if((n & 0xffff) == 0) {
-			/* Output some dots while executing the program. */
+		if((n & 0xffff) == 0 && !replaying && log_fp) {
+			/* Output some dots while executing the program in the monitor. */
 			fputc('.', stderr);
 		}
 #endif
@@ -64,27 +75,42 @@ void cpu_exec(volatile uint32_t n) {
 		int instr_len = exec(cpu.eip);
 
 		cpu.eip += instr_len;
+		nr_instr ++;
 
 #ifdef DEBUG
-		print_bin_instr(eip_temp, instr_len);
-		strcat(asm_buf, assembly);
-		Log_write("%s\n", asm_buf);
-		if(n_temp < MAX_INSTR_TO_PRINT) {
-			printf("%s\n", asm_buf);
+		if(!replaying && (log_fp || n_temp < MAX_INSTR_TO_PRINT)) {
+			print_bin_instr(eip_temp, instr_len);
+			strcat(asm_buf, assembly);
+			Log_write("%s\n", asm_buf);
+			if(n_temp < MAX_INSTR_TO_PRINT) {
+				printf("%s\n", asm_buf);
+			}
 		}
 #endif
 
 		/* TODO: check watchpoints here. */
         if (!check_wp())
             nemu_state = STOP;
+		if(nemu_state == STOP) { last_stop = nr_instr; }
 
 #ifdef HAS_DEVICE
+		event_update();
+
 		extern void device_update();
 		device_update();
 #endif
 
-		if(nemu_state != RUNNING) { return; }
+		/* after the events, so that they are in the checkpoint */
+		checkpoint_update();
+
+		if(nemu_state != RUNNING) { break; }
 	}
 
 	if(nemu_state == RUNNING) { nemu_state = STOP; }
+
+#ifdef HAS_DEVICE
+	/* show what the program has printed before the monitor takes over */
+	extern void serial_flush();
+	serial_flush();
+#endif
 }
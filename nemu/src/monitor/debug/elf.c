@@ -1,4 +1,5 @@
 #include "common.h"
+#include "memory/memory.h"
 #include <stdlib.h>
 #include <elf.h>
 
@@ -10,7 +11,7 @@ static int nr_symtab_entry;
 
 void load_elf_tables(int argc, char *argv[]) {
 	int ret;
-	Assert(argc == 2, "run NEMU with format 'nemu [program]'");
+	Assert(argc == 2, "run NEMU with format 'nemu [OPTION...] [program]'");
 	exec_file = argv[1];
 
 	FILE *fp = fopen(exec_file, "rb");
@@ -81,3 +82,50 @@ void load_elf_tables(int argc, char *argv[]) {
 	fclose(fp);
 }
 
+
+/* Load the program segments of `exec_file' into the physical memory
+ * at their physical addresses and zero the .bss. This replaces the
+ * ramdisk, the `entry' file and the loader in the guest kernel when
+ * NEMU is run with `--elf'. Return the entry of the program.
+ */
+swaddr_t load_elf_image() {
+	int ret;
+	FILE *fp = fopen(exec_file, "rb");
+	Assert(fp, "Can not open '%s'", exec_file);
+
+	Elf32_Ehdr elf;
+	ret = fread(&elf, sizeof(elf), 1, fp);
+	assert(ret == 1);
+
+	Assert(elf.e_phnum > 0, "'%s' has no program headers to load", exec_file);
+	Assert(elf.e_phentsize == sizeof(Elf32_Phdr), "'%s' has program headers of a wrong size", exec_file);
+	uint32_t ph_size = elf.e_phentsize * elf.e_phnum;
+	Elf32_Phdr *ph = malloc(ph_size);
+	fseek(fp, elf.e_phoff, SEEK_SET);
+	ret = fread(ph, ph_size, 1, fp);
+	assert(ret == 1);
+
+	int i;
+	for(i = 0; i < elf.e_phnum; i ++) {
+		if(ph[i].p_type != PT_LOAD) { continue; }
+
+		hwaddr_t addr = ph[i].p_paddr;
+		Assert(ph[i].p_filesz <= ph[i].p_memsz, "segment at 0x%x is larger in the file (0x%x) than in memory (0x%x)",
+				addr, ph[i].p_filesz, ph[i].p_memsz);
+		Assert(addr + ph[i].p_memsz <= HW_MEM_SIZE && addr + ph[i].p_memsz >= addr,
+				"segment [0x%x, 0x%x) is outside of the physical memory",
+				addr, addr + ph[i].p_memsz);
+
+		if(ph[i].p_filesz != 0) {
+			fseek(fp, ph[i].p_offset, SEEK_SET);
+			ret = fread(hwa_to_va(addr), ph[i].p_filesz, 1, fp);
+			assert(ret == 1);
+		}
+		memset(hwa_to_va(addr + ph[i].p_filesz), 0, ph[i].p_memsz - ph[i].p_filesz);
+	}
+
+	free(ph);
+	fclose(fp);
+
+	return elf.e_entry;
+}
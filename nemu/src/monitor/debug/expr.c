@@ -121,8 +121,8 @@ typedef struct token {
 	char str[32];
 } Token;
 
-Token tokens[32];
-int nr_token;
+machine_local Token tokens[32];
+machine_local int nr_token;
 
 static bool make_token(char *e) {
 	int position = 0;
@@ -140,7 +140,8 @@ static bool make_token(char *e) {
 				char *substr_start = e + position;
 				int substr_len = pmatch.rm_eo;
 
-				Log("match rules[%d] = \"%s\" at position %d with len %d: %.*s",
+				/* only to the log, as expr() is also used by the watchpoints */
+				Log_write("match rules[%d] = \"%s\" at position %d with len %d: %.*s\n",
                     i, rules[i].regex, position, substr_len,
                     substr_len, substr_start);
 				position += substr_len;
@@ -217,8 +218,8 @@ static uint32_t operate(int op, uint32_t obj1, uint32_t obj2)
 #define POP_OBJ(x) do { x = obj_stack[--obj_i]; } while (0)
 static uint32_t eval(bool *success)
 {
-    static int op_stack[32];
-    static uint32_t obj_stack[32];
+    static machine_local int op_stack[32];
+    static machine_local uint32_t obj_stack[32];
     int obj_i = 0, op_i = 0;
     int token_type, i;
     int op;
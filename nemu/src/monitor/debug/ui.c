@@ -2,6 +2,10 @@
 #include "monitor/expr.h"
 #include "monitor/watchpoint.h"
 #include "nemu.h"
+#include "cpu/ifetch.h"
+#include "device/disk.h"
+#include "monitor/savestate.h"
+#include "monitor/checkpoint.h"
 
 #include <stdlib.h>
 #include <readline/readline.h>
@@ -77,6 +81,17 @@ static int cmd_info(char *args) {
     } else if (strcmp(subcmd, "w") == 0) {
         /* TODO: implement info watchpoint */
         print_wp();
+    } else if (strcmp(subcmd, "m") == 0) {
+        void dram_info();
+        dram_info();
+    } else if (strcmp(subcmd, "f") == 0) {
+        extern machine_local uint64_t nr_instr;
+        uint64_t n = (nr_instr ? nr_instr : 1);
+        printf("instructions\t%llu\n", (unsigned long long)nr_instr);
+        printf("instr_fetch\t%llu\t(%.2f per instr, without prefetch buffer)\n",
+                (unsigned long long)ifb.nr_fetch, (double)ifb.nr_fetch / n);
+        printf("bus reads\t%llu\t(%.2f per instr, with prefetch buffer)\n",
+                (unsigned long long)ifb.nr_bus_read, (double)ifb.nr_bus_read / n);
     }
 	return 0;
 }
@@ -89,6 +104,19 @@ static int cmd_si(char *args) {
     return 0;
 }
 
+static int cmd_rsi(char *args) {
+    int n;
+    if (args == NULL || (sscanf(args, "%i", &n) != 1))
+        n = 1;
+    reverse_step(n);
+    return 0;
+}
+
+static int cmd_rc(char *args) {
+    reverse_continue();
+    return 0;
+}
+
 static int cmd_p(char *args) {
     bool success;
     uint32_t result;
@@ -146,6 +174,51 @@ static int cmd_d(char *args) {
     return 0;
 }
 
+static int cmd_disk(char *args) {
+    char *subcmd = strtok(NULL, " ");
+    if (subcmd == NULL || strcmp(subcmd, "info") == 0) {
+        disk_info();
+    } else if (strcmp(subcmd, "commit") == 0) {
+        disk_commit();
+    } else if (strcmp(subcmd, "discard") == 0) {
+        disk_discard();
+    } else {
+        printf("Unknown subcommand '%s'\n", subcmd);
+    }
+    return 0;
+}
+
+bool snapshot_take();
+void snapshot_restore();
+
+static int cmd_snapshot(char *args) {
+#ifdef HAS_DEVICE
+	/* The SDL window can not be shared by the processes. */
+	extern const char *capture_file;
+	if(capture_file == NULL) {
+		printf("Snapshots need the headless display (--capture)\n");
+		return 0;
+	}
+#endif
+	snapshot_take();
+	return 0;
+}
+
+static int cmd_restore(char *args) {
+	snapshot_restore();
+	return 0;
+}
+
+static int cmd_save(char *args) {
+	char *path = strtok(NULL, " ");
+	if(path == NULL) {
+		printf("Usage: save FILE\n");
+		return 0;
+	}
+	save_state(path);
+	return 0;
+}
+
 static int cmd_help(char *args);
 
 static struct {
@@ -157,11 +230,17 @@ static struct {
 	{ "c", "Continue the execution of the program", cmd_c },
 	{ "q", "Exit NEMU", cmd_q },
     { "si", "Step [N] instruction exactly.", cmd_si },
-    { "info", "[r] List registers; [w] List watchpoints.", cmd_info },
+    { "rsi", "Step [N] instruction back, see --checkpoint-interval.", cmd_rsi },
+    { "rc", "Continue backwards to the last breakpoint or watchpoint hit.", cmd_rc },
+    { "info", "[r] List registers; [w] List watchpoints; [m] Physical memory usage; [f] Instruction fetch statistics.", cmd_info },
     { "x", "Examine the contents of memory.", cmd_x },
     { "p", "Print the value of the expression", cmd_p},
     { "w", "Watchpoint", cmd_w},
     { "d", "Delete watchpoint", cmd_d},
+    { "disk", "[info] Show the disk overlay; [commit] Write it back to the image; [discard] Drop it.", cmd_disk},
+    { "snapshot", "Take a snapshot of the whole machine in memory.", cmd_snapshot},
+    { "restore", "Go back to the latest snapshot.", cmd_restore},
+    { "save", "FILE Save the whole machine to FILE, see --load-state.", cmd_save},
 
 	/* TODO: Add more commands */
 
@@ -193,6 +272,17 @@ static int cmd_help(char *args) {
 }
 
 void ui_mainloop() {
+	void init_replay();
+	init_replay();
+	init_checkpoint();
+
+	extern uint32_t snapshot_at;
+	if(snapshot_at != 0) {
+		/* boot, and run every later command from this point with `restore' */
+		cpu_exec(snapshot_at);
+		cmd_snapshot(NULL);
+	}
+
 	while(1) {
 		char *str = rl_gets();
 		char *str_end = str + strlen(str);
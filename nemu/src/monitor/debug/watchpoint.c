@@ -4,8 +4,13 @@
 
 #define NR_WP 32
 
-static WP wp_pool[NR_WP];
-static WP *head, *free_;
+static machine_local WP wp_pool[NR_WP];
+static machine_local WP *head, *free_;
+
+/* off while re-executing to a point in reverse execution */
+static machine_local bool wp_enabled = true;
+
+extern machine_local bool replaying;
 
 void init_wp_pool() {
 	int i;
@@ -52,12 +57,16 @@ bool check_wp()
     bool success;
     bool if_change = false;
 
+    if (!wp_enabled)
+        return true;
+
     for (p = head; p; p = p->next) {
         val = expr(p->expr, &success);
         Assert(success, "invalid expression.");
         if (val != p->old) {
-            printf("\n%s:\nOld value = %d\nNew value = %d\n",
-                   p->expr, p->old, val);
+            if (!replaying)
+                printf("\n%s:\nOld value = %d\nNew value = %d\n",
+                       p->expr, p->old, val);
             p->old = val;
             if_change = true;
         }
@@ -82,3 +91,17 @@ void print_wp()
     for (p = head; p; p = p->next)
         printf("%d\t%s\n", p->NO, p->expr);
 }
+
+void wp_enable(bool enable)
+{
+    wp_enabled = enable;
+}
+
+/* Take the current values as the old ones, after going back in time. */
+void wp_resync()
+{
+    WP *p;
+    bool success;
+    for (p = head; p; p = p->next)
+        p->old = expr(p->expr, &success);
+}
@@ -1,4 +1,10 @@
 #include "nemu.h"
+#include "cpu/ifetch.h"
+#include "monitor/savestate.h"
+#include "device/port-io.h"
+
+#include <stdlib.h>
+#include <getopt.h>
 
 #define ENTRY_START 0x100000
 
@@ -10,6 +16,8 @@ void load_elf_tables(int, char *[]);
 void init_regex();
 void init_wp_pool();
 void init_ddr3();
+void init_dram(uint32_t);
+swaddr_t load_elf_image();
 
 FILE *log_fp = NULL;
 
@@ -23,23 +31,203 @@ static void welcome() {
 			exec_file);
 }
 
+static uint32_t mem_size = HW_MEM_SIZE_DEFAULT;
+static const char *state_file = NULL;
+
+/* set by the command line options, or by nemu_create() */
+bool elf_boot = false;
+bool batch_mode = false;
+
+static void usage(const char *name) {
+	printf("Usage: %s [OPTION...] [program]\n\n", name);
+	printf("  -m, --mem=SIZE         size of the physical memory in MB (default: %d);\n"
+		   "                         below %d only with --elf, as the testcases and the\n"
+		   "                         kernel put their stack at %d MB\n",
+			HW_MEM_SIZE_DEFAULT >> 20, MIN_BOOT_MEM_SIZE >> 20, MIN_BOOT_MEM_SIZE >> 20);
+	printf("      --elf              load the segments of the program directly and start\n"
+		   "                         from its entry, without ramdisk, 'entry' and the loader\n");
+	printf("      --ide-latency=N    complete IDE DMA commands N instructions after they\n"
+		   "                         are issued, while a host thread does the transfer\n");
+	printf("      --disk-overlay=FILE  keep the writes to the disk in FILE instead of\n"
+		   "                         memory; the program image is never modified\n");
+	printf("      --capture=FILE     run without a window, and capture the screen to FILE\n"
+		   "                         (.ppm, .y4m, or raw RGB; \"%%d\" in FILE for one file\n"
+		   "                         per frame), with a hash of each frame in the log\n");
+	printf("      --capture-interval=N  capture the screen every N instructions\n"
+		   "                         if it has changed (default: 100000)\n");
+	printf("      --keys=FILE        type the keys in the script FILE at the given\n"
+		   "                         instruction counts or screen refreshes\n");
+	printf("      --serial=FILE      write the output of the serial port to FILE,\n"
+		   "                         or to the descriptor N with \"fd:N\" (default: stdout)\n");
+	printf("      --snapshot-at=N    run N instructions and take a snapshot before\n"
+		   "                         the first command, see 'snapshot' and 'restore'\n"
+		   "                         (not with --batch)\n");
+	printf("      --checkpoint-interval=N  take a checkpoint every N instructions\n"
+		   "                         for 'rsi' and 'rc' (default: 0, no checkpoints)\n");
+	printf("      --record=FILE      record the timer, screen refreshes and keys of the\n"
+		   "                         window to FILE, with the instruction of each\n");
+	printf("      --replay=FILE      feed the inputs recorded in FILE instead of the\n"
+		   "                         live ones, which repeats the recorded run\n");
+	printf("      --batch            run the program to the end without the monitor, and\n"
+		   "                         print its status, instruction count, wall time and\n"
+		   "                         MIPS as JSON; no log.txt is written\n");
+	printf("      --max-instr=N      stop a batch run after N instructions\n");
+	printf("      --load-state=FILE  start from the save-state FILE instead of booting,\n"
+		   "                         see the 'save' command\n");
+	printf("  -h, --help             display this help and exit\n");
+}
+
+/* Parse the options. On return, `argv[optind]' is the program. */
+static void parse_args(int argc, char *argv[]) {
+	const struct option long_options[] = {
+		{ "mem", required_argument, NULL, 'm' },
+		{ "elf", no_argument, NULL, 'E' },
+		{ "ide-latency", required_argument, NULL, 'L' },
+		{ "disk-overlay", required_argument, NULL, 'O' },
+		{ "capture", required_argument, NULL, 'C' },
+		{ "capture-interval", required_argument, NULL, 'I' },
+		{ "keys", required_argument, NULL, 'K' },
+		{ "serial", required_argument, NULL, 'S' },
+		{ "snapshot-at", required_argument, NULL, 'A' },
+		{ "checkpoint-interval", required_argument, NULL, 'P' },
+		{ "record", required_argument, NULL, 'V' },
+		{ "replay", required_argument, NULL, 'Y' },
+		{ "batch", no_argument, NULL, 'B' },
+		{ "max-instr", required_argument, NULL, 'X' },
+		{ "load-state", required_argument, NULL, 'R' },
+		{ "help", no_argument, NULL, 'h' },
+		{ 0, 0, 0, 0 }
+	};
+
+	int c;
+	while((c = getopt_long(argc, argv, "m:h", long_options, NULL)) != -1) {
+		switch(c) {
+			case 'm': {
+				char *end;
+				unsigned long mb = strtoul(optarg, &end, 0);
+				Assert(*end == '\0' && mb > 0 && mb <= 2048, "invalid memory size '%s'", optarg);
+				mem_size = mb << 20;
+				break;
+			}
+			case 'E': elf_boot = true; break;
+			case 'L': {
+				extern uint32_t ide_latency;
+				char *end;
+				ide_latency = strtoul(optarg, &end, 0);
+				Assert(*end == '\0', "invalid IDE latency '%s'", optarg);
+				break;
+			}
+			case 'O': {
+				extern const char *disk_overlay;
+				disk_overlay = optarg;
+				break;
+			}
+			case 'C': {
+				extern const char *capture_file;
+				capture_file = optarg;
+				break;
+			}
+			case 'I': {
+				extern uint32_t capture_interval;
+				char *end;
+				capture_interval = strtoul(optarg, &end, 0);
+				Assert(*end == '\0' && capture_interval > 0, "invalid capture interval '%s'", optarg);
+				break;
+			}
+			case 'K': {
+				extern const char *key_script;
+				key_script = optarg;
+				break;
+			}
+			case 'S': {
+				extern const char *serial_sink;
+				serial_sink = optarg;
+				break;
+			}
+			case 'A': {
+				extern uint32_t snapshot_at;
+				char *end;
+				snapshot_at = strtoul(optarg, &end, 0);
+				Assert(*end == '\0', "invalid instruction count '%s'", optarg);
+				break;
+			}
+			case 'P': {
+				extern uint32_t checkpoint_interval;
+				char *end;
+				checkpoint_interval = strtoul(optarg, &end, 0);
+				Assert(*end == '\0', "invalid checkpoint interval '%s'", optarg);
+				break;
+			}
+			case 'V': {
+				extern const char *record_file;
+				record_file = optarg;
+				break;
+			}
+			case 'Y': {
+				extern const char *replay_file;
+				replay_file = optarg;
+				break;
+			}
+			case 'B': batch_mode = true; break;
+			case 'X': {
+				extern uint64_t batch_max_instr;
+				char *end;
+				batch_max_instr = strtoull(optarg, &end, 0);
+				Assert(*end == '\0', "invalid instruction count '%s'", optarg);
+				break;
+			}
+			case 'R': state_file = optarg; break;
+			case 'h':
+				usage(argv[0]);
+				exit(0);
+			default:
+				usage(argv[0]);
+				exit(1);
+		}
+	}
+
+	extern uint32_t snapshot_at;
+	Assert(!(batch_mode && snapshot_at != 0), "--snapshot-at needs the monitor, it can not be used with --batch");
+
+	Assert(elf_boot || mem_size >= MIN_BOOT_MEM_SIZE,
+			"%d MB of memory is too small for the stack of the program, use --elf or at least %d MB",
+			mem_size >> 20, MIN_BOOT_MEM_SIZE >> 20);
+}
+
+/* Set up a machine on the calling thread. Another thread can then run
+ * its own guest with restart() and cpu_exec().
+ */
+void init_machine(uint32_t mem_size) {
+	/* Allocate the physical memory. */
+	init_dram(mem_size);
+
+	/* Allocate the I/O ports. */
+	init_port_io();
+
+	/* Initialize the watchpoint pool. */
+	init_wp_pool();
+}
+
 void init_monitor(int argc, char *argv[]) {
 	/* Perform some global initialization */
 
-	/* Open the log file. */
-	init_log();
+	/* Parse the command line options. */
+	parse_args(argc, argv);
+
+	/* Open the log file. A batch run has none. */
+	if(!batch_mode) { init_log(); }
 
 	/* Load the string table and symbol table from the ELF file for future use. */
-	load_elf_tables(argc, argv);
+	load_elf_tables(argc - optind + 1, argv + optind - 1);
 
 	/* Compile the regular expressions. */
 	init_regex();
 
-	/* Initialize the watchpoint pool. */
-	init_wp_pool();
+	/* Set up the machine of the main thread. */
+	init_machine(mem_size);
 
 	/* Display welcome message. */
-	welcome();
+	if(!batch_mode) { welcome(); }
 }
 
 #ifdef USE_RAMDISK
@@ -76,6 +264,25 @@ static void load_entry() {
 
 void restart() {
 	/* Perform some initialization to restart a program */
+	if(state_file) {
+		/* Everything comes from the save-state, skip the boot. */
+		load_state(state_file);
+		return;
+	}
+
+	if(elf_boot) {
+		/* Place the PT_LOAD segments into memory and start from the entry. */
+		cpu.eip = load_elf_image();
+
+		/* Set up a stack at the top of the physical memory, as start.S does. */
+		cpu.ebp = 0;
+		cpu.esp = hw_mem_size - 16;
+
+		ifb_flush();
+		init_ddr3();
+		return;
+	}
+
 #ifdef USE_RAMDISK
 	/* Read the file with name `argv[1]' into ramdisk. */
 	init_ramdisk();
@@ -84,6 +291,9 @@ void restart() {
 	/* Read the entry code into memory. */
 	load_entry();
 
+	/* Drop the stale instruction stream in the prefetch buffer. */
+	ifb_flush();
+
 	/* Set the initial instruction pointer. */
 	cpu.eip = ENTRY_START;
 
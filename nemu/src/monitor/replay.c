@@ -0,0 +1,151 @@
+#include "nemu.h"
+#include "monitor/replay.h"
+
+#include <stdlib.h>
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t nr_instr;
+	CPU_state cpu;
+} ReplayHeader;
+
+/* set by the command line options */
+const char *record_file = NULL;
+const char *replay_file = NULL;
+
+int replay_mode = REPLAY_OFF;
+uint64_t next_input_time = -1ull;
+
+/* the time of the previous input */
+static uint64_t last_time;
+
+static FILE *record_fp;
+
+static uint8_t *log_buf;
+static size_t log_len, log_pos;
+static int next_type;
+static uint8_t next_data;
+
+void record_input(int type, uint8_t data) {
+	if(replay_mode != REPLAY_RECORD) {
+		return;
+	}
+
+	uint64_t v = (nr_instr - last_time) << 2 | type;
+	last_time = nr_instr;
+	uint8_t buf[16];
+	int len = 0;
+	do {
+		buf[len] = v & 0x7f;
+		v >>= 7;
+		if(v) { buf[len] |= 0x80; }
+		len ++;
+	} while(v);
+	if(type == INPUT_KEY) { buf[len ++] = data; }
+
+	fwrite(buf, len, 1, record_fp);
+	if(type == INPUT_QUIT) {
+		fflush(record_fp);
+	}
+}
+
+/* Decode the next input, or set no more. */
+static void fetch_next() {
+	uint64_t v = 0;
+	int shift = 0;
+	if(log_pos >= log_len) {
+		next_input_time = -1ull;
+		return;
+	}
+	while(1) {
+		Assert(log_pos < log_len && shift < 64, "corrupted recording '%s'", replay_file);
+		uint8_t b = log_buf[log_pos ++];
+		v |= (uint64_t)(b & 0x7f) << shift;
+		shift += 7;
+		if(!(b & 0x80)) { break; }
+	}
+
+	next_type = v & 3;
+	if(next_type == INPUT_KEY) {
+		Assert(log_pos < log_len, "corrupted recording '%s'", replay_file);
+		next_data = log_buf[log_pos ++];
+	}
+	next_input_time = last_time + (v >> 2);
+	last_time = next_input_time;
+}
+
+void replay_inputs() {
+	while(nr_instr >= next_input_time) {
+		if(nr_instr > next_input_time) {
+			/* a monitor command has changed the run, e.g. rsi */
+			printf("The run diverges from the recording at instruction %llu\n",
+					(unsigned long long)nr_instr);
+			next_input_time = -1ull;
+			return;
+		}
+#ifdef HAS_DEVICE
+		void device_input(int, uint8_t);
+		int type = next_type;
+		uint8_t data = next_data;
+		fetch_next();
+		device_input(type, data);
+#else
+		fetch_next();
+#endif
+	}
+}
+
+static void start_record() {
+	record_fp = fopen(record_file, "wb");
+	Assert(record_fp, "Can not open '%s'", record_file);
+
+	ReplayHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, REPLAY_MAGIC, 8);
+	h.version = REPLAY_VERSION;
+	h.nr_instr = nr_instr;
+	h.cpu = cpu;
+	fwrite(&h, sizeof(h), 1, record_fp);
+
+	last_time = nr_instr;
+	replay_mode = REPLAY_RECORD;
+}
+
+static void start_replay() {
+	FILE *fp = fopen(replay_file, "rb");
+	Assert(fp, "Can not open '%s'", replay_file);
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	ReplayHeader h;
+	Assert(size >= sizeof(h) && fread(&h, sizeof(h), 1, fp) == 1 &&
+			memcmp(h.magic, REPLAY_MAGIC, 8) == 0, "'%s' is not a recording", replay_file);
+	Assert(h.version == REPLAY_VERSION, "'%s' is of version %d, but version %d is supported",
+			replay_file, h.version, REPLAY_VERSION);
+	Assert(h.nr_instr == nr_instr, "'%s' starts at instruction %llu, but the machine is at %llu",
+			replay_file, (unsigned long long)h.nr_instr, (unsigned long long)nr_instr);
+
+	log_len = size - sizeof(h);
+	log_buf = malloc(log_len + 1);
+	assert(log_buf);
+	int ret = fread(log_buf, 1, log_len, fp);
+	assert(ret == log_len);
+	fclose(fp);
+
+	/* the registers of the recorded run */
+	cpu = h.cpu;
+
+	log_pos = 0;
+	last_time = nr_instr;
+	fetch_next();
+	replay_mode = REPLAY_PLAY;
+}
+
+void init_replay() {
+	Assert(!(record_file && replay_file), "can not record and replay at the same time");
+	if(record_file) { start_record(); }
+	else if(replay_file) { start_replay(); }
+}
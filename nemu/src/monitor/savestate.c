@@ -0,0 +1,334 @@
+#include "nemu.h"
+#include "monitor/savestate.h"
+#include "cpu/ifetch.h"
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SS_PAGE_WIDTH 12
+#define SS_PAGE_SIZE (1 << SS_PAGE_WIDTH)
+
+#define ALIGN8(x) (((x) + 7) & ~7ul)
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+} SaveHeader;
+
+typedef struct {
+	char tag[4];
+	uint32_t reserved;
+	uint64_t size;
+} SectionHeader;
+
+typedef struct {
+	CPU_state cpu;
+	uint64_t nr_instr;
+} CPUSection;
+
+typedef struct {
+	uint32_t mem_size;
+	uint32_t page_size;
+} RAMHeader;
+
+/* a page in the RAM section, followed by `len' bytes of its encoding */
+typedef struct {
+	uint32_t page;
+	uint32_t len;
+} PageRecord;
+
+extern machine_local uint64_t nr_instr;
+
+void init_ddr3();
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* writing */
+
+static machine_local FILE *save_fp;
+static machine_local long section_start;
+
+static void section_begin(const char *tag) {
+	SectionHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.tag, tag, 4);
+	section_start = ftell(save_fp);
+	fwrite(&h, sizeof(h), 1, save_fp);
+}
+
+static void section_end() {
+	long end = ftell(save_fp);
+	uint64_t size = end - section_start - sizeof(SectionHeader);
+	static const char pad[8];
+	fwrite(pad, ALIGN8(size) - size, 1, save_fp);
+
+	fseek(save_fp, section_start + offsetof(SectionHeader, size), SEEK_SET);
+	fwrite(&size, sizeof(size), 1, save_fp);
+	fseek(save_fp, 0, SEEK_END);
+}
+
+void savestate_put(const char *tag, const void *data, size_t len) {
+	section_begin(tag);
+	fwrite(data, len, 1, save_fp);
+	section_end();
+}
+
+/* PackBits: a control byte c < 128 is followed by c + 1 literal bytes,
+ * and c >= 128 by one byte repeated 257 - c times. A page grows by at
+ * most 1/128 in the worst case.
+ */
+static int rle_encode(uint8_t *out, const uint8_t *in, int n) {
+	int i = 0, len = 0;
+	while(i < n) {
+		int run = 1;
+		while(i + run < n && run < 128 && in[i + run] == in[i]) { run ++; }
+		if(run >= 3) {
+			out[len ++] = 257 - run;
+			out[len ++] = in[i];
+			i += run;
+			continue;
+		}
+
+		/* shorter runs are cheaper as literals */
+		int lit = 1;
+		while(i + lit < n && lit < 128 && !(i + lit + 2 < n &&
+					in[i + lit] == in[i + lit + 1] && in[i + lit] == in[i + lit + 2])) { lit ++; }
+		out[len ++] = lit - 1;
+		memcpy(out + len, in + i, lit);
+		len += lit;
+		i += lit;
+	}
+	return len;
+}
+
+/* The input comes from the file, so it is checked to stay in `in' and
+ * to decode to at most `out_len' bytes.
+ */
+static void rle_decode(uint8_t *out, int out_len, const uint8_t *in, int len) {
+	int i = 0, n;
+	while(i < len) {
+		uint8_t c = in[i ++];
+		n = (c < 128 ? c + 1 : 257 - c);
+		Assert(n <= out_len && i + (c < 128 ? n : 1) <= len, "corrupted page in the save-state");
+		if(c < 128) {
+			memcpy(out, in + i, n);
+			i += n;
+		}
+		else {
+			memset(out, in[i ++], n);
+		}
+		out += n;
+		out_len -= n;
+	}
+}
+
+/* Return the number of pages saved. */
+static uint32_t save_ram() {
+	static const uint8_t zero[SS_PAGE_SIZE];
+	static machine_local uint8_t buf[SS_PAGE_SIZE + SS_PAGE_SIZE / 128 + 8];
+
+	uint32_t nr_page = hw_mem_size >> SS_PAGE_WIDTH, i, nr_saved = 0;
+
+	section_begin("RAM ");
+	RAMHeader h = { hw_mem_size, SS_PAGE_SIZE };
+	fwrite(&h, sizeof(h), 1, save_fp);
+	for(i = 0; i < nr_page; i ++) {
+		uint8_t *p = hw_mem + ((size_t)i << SS_PAGE_WIDTH);
+		if(memcmp(p, zero, SS_PAGE_SIZE) == 0) { continue; }
+
+		PageRecord r = { i, rle_encode(buf, p, SS_PAGE_SIZE) };
+		fwrite(&r, sizeof(r), 1, save_fp);
+		fwrite(buf, r.len, 1, save_fp);
+		nr_saved ++;
+	}
+	section_end();
+
+	return nr_saved;
+}
+
+bool save_state(const char *path) {
+#ifdef HAS_DEVICE
+	bool devices_quiescent();
+	if(!devices_quiescent()) {
+		printf("A device is busy, try again later.\n");
+		return false;
+	}
+#endif
+
+	double start = now();
+	save_fp = fopen(path, "wb");
+	if(save_fp == NULL) {
+		printf("Can not open '%s'\n", path);
+		return false;
+	}
+
+	SaveHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, SAVESTATE_MAGIC, 8);
+	h.version = SAVESTATE_VERSION;
+	fwrite(&h, sizeof(h), 1, save_fp);
+
+	CPUSection c = { cpu, nr_instr };
+	savestate_put("CPU ", &c, sizeof(c));
+
+	uint32_t nr_page = save_ram();
+
+#ifdef HAS_DEVICE
+	void save_devices();
+	save_devices();
+#endif
+
+	section_begin("END ");
+	section_end();
+
+	long size = ftell(save_fp);
+	fclose(save_fp);
+	save_fp = NULL;
+
+	printf("Saved to '%s': %d non-zero pages, %ld KB, in %.3f ms\n",
+			path, nr_page, size >> 10, (now() - start) * 1e3);
+	return true;
+}
+
+/* loading */
+
+static machine_local uint8_t *load_base;
+static machine_local size_t load_size;
+
+const void *savestate_get(const char *tag, size_t *len) {
+	size_t off = sizeof(SaveHeader);
+	while(off + sizeof(SectionHeader) <= load_size) {
+		SectionHeader *s = (void *)(load_base + off);
+		Assert(off + sizeof(SectionHeader) + s->size <= load_size, "corrupted save-state");
+		if(memcmp(s->tag, tag, 4) == 0) {
+			if(len) { *len = s->size; }
+			return s + 1;
+		}
+		if(memcmp(s->tag, "END ", 4) == 0) { break; }
+		off += sizeof(SectionHeader) + ALIGN8(s->size);
+	}
+	return NULL;
+}
+
+void savestate_get_copy(const char *tag, void *data, size_t len) {
+	size_t size;
+	const void *p = savestate_get(tag, &size);
+	Assert(p && size == len, "section '%.4s' is missing or has a wrong size in the save-state", tag);
+	memcpy(data, p, len);
+}
+
+static void load_ram() {
+	size_t size;
+	const uint8_t *p = savestate_get("RAM ", &size);
+	Assert(p, "no RAM in the save-state");
+	const uint8_t *end = p + size;
+
+	const RAMHeader *h = (void *)p;
+	Assert(size >= sizeof(*h), "corrupted save-state");
+	Assert(h->mem_size == hw_mem_size, "the save-state has %d MB of memory, run with --mem=%d",
+			h->mem_size >> 20, h->mem_size >> 20);
+	Assert(h->page_size == SS_PAGE_SIZE, "corrupted save-state");
+	p += sizeof(*h);
+
+	/* Start from all-zero memory, the zero pages are not in the file. */
+	madvise(hw_mem, hw_mem_size, MADV_DONTNEED);
+
+	while(p < end) {
+		const PageRecord *r = (void *)p;
+		Assert(end - p >= sizeof(*r) && r->len <= end - p - sizeof(*r), "corrupted save-state");
+		Assert(r->page < (hw_mem_size >> SS_PAGE_WIDTH), "corrupted save-state");
+		rle_decode(hw_mem + ((size_t)r->page << SS_PAGE_WIDTH), SS_PAGE_SIZE, (void *)(r + 1), r->len);
+		p += sizeof(*r) + r->len;
+	}
+}
+
+void load_state(const char *path) {
+	double start = now();
+
+	int fd = open(path, O_RDONLY);
+	Assert(fd >= 0, "Can not open '%s'", path);
+	struct stat st;
+	int ret = fstat(fd, &st);
+	assert(ret == 0);
+	load_size = st.st_size;
+	load_base = mmap(NULL, load_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	Assert(load_base != MAP_FAILED, "Can not map '%s'", path);
+	close(fd);
+
+	const SaveHeader *h = (void *)load_base;
+	Assert(load_size >= sizeof(*h) && memcmp(h->magic, SAVESTATE_MAGIC, 8) == 0,
+			"'%s' is not a save-state", path);
+	Assert(h->version == SAVESTATE_VERSION, "'%s' is of version %d, but version %d is supported",
+			path, h->version, SAVESTATE_VERSION);
+
+	CPUSection c;
+	savestate_get_copy("CPU ", &c, sizeof(c));
+	cpu = c.cpu;
+	nr_instr = c.nr_instr;
+
+	load_ram();
+
+#ifdef HAS_DEVICE
+	void load_devices();
+	load_devices();
+#endif
+
+	munmap(load_base, load_size);
+	load_base = NULL;
+
+	ifb_flush();
+	init_ddr3();
+
+	printf("Loaded '%s' at %llu instructions, eip = 0x%08x, in %.3f ms\n",
+			path, (unsigned long long)nr_instr, cpu.eip, (now() - start) * 1e3);
+}
+
+/* The device state of a checkpoint for reverse execution is the same
+ * sections, kept in memory. The disk is left out.
+ */
+machine_local bool savestate_in_memory = false;
+
+#ifdef HAS_DEVICE
+void *save_devices_mem(size_t *len) {
+	char *buf;
+	save_fp = open_memstream(&buf, len);
+	Assert(save_fp, "Can not save the devices");
+
+	SaveHeader h;
+	memset(&h, 0, sizeof(h));
+	fwrite(&h, sizeof(h), 1, save_fp);
+
+	void save_devices();
+	savestate_in_memory = true;
+	save_devices();
+	savestate_in_memory = false;
+
+	section_begin("END ");
+	section_end();
+	fclose(save_fp);
+	save_fp = NULL;
+	return buf;
+}
+
+void load_devices_mem(void *buf, size_t len) {
+	load_base = buf;
+	load_size = len;
+
+	void load_devices();
+	savestate_in_memory = true;
+	load_devices();
+	savestate_in_memory = false;
+
+	load_base = NULL;
+}
+#endif
@@ -0,0 +1,94 @@
+#include "common.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/* In-memory snapshots with fork().
+ * Taking a snapshot forks NEMU. The parent keeps the state at that
+ * point (CPU, physical memory, devices and the monitor itself) without
+ * touching it, and waits for the child, which goes on running. To
+ * restore, the child writes a byte to a pipe shared with the parent and
+ * exits, and the parent forks again from the saved state. Any exit status
+ * of the child, whatever the guest returns, is passed on. Pages are shared copy-on-write, so both
+ * operations cost about as much as the memory touched in between.
+ * Snapshots nest: `restore' goes back to the latest one.
+ * Writes to a disk overlay kept in a file (--disk-overlay) are shared
+ * by all the processes and are not rolled back.
+ */
+
+static int depth = 0;
+
+/* the write end of the pipe to the parent of the latest snapshot */
+static int restore_fd = -1;
+
+/* set by the command line options */
+uint32_t snapshot_at = 0;
+
+static void flush_output() {
+	fflush(stdout);
+	fflush(stderr);
+	if(log_fp) { fflush(log_fp); }
+#ifdef HAS_DEVICE
+	extern void serial_flush();
+	serial_flush();
+#endif
+}
+
+/* Return in the child, which continues from the snapshot. Only return
+ * in the parent if fork() fails.
+ */
+bool snapshot_take() {
+	flush_output();
+	bool restored = false;
+	while(1) {
+		int fd[2];
+		if(pipe(fd) != 0) {
+			perror("pipe");
+			return false;
+		}
+		pid_t pid = fork();
+		if(pid < 0) {
+			perror("fork");
+			close(fd[0]);
+			close(fd[1]);
+			return false;
+		}
+
+		if(pid == 0) {
+			close(fd[0]);
+			if(restore_fd != -1) { close(restore_fd); }
+			restore_fd = fd[1];
+			depth ++;
+			if(restored) { printf("Restored to snapshot %d\n", depth); }
+			else { printf("Snapshot %d taken\n", depth); }
+			return true;
+		}
+
+		close(fd[1]);
+		int status;
+		while(waitpid(pid, &status, 0) < 0);
+		/* All the writers have exited, so the read does not block. */
+		char c;
+		restored = (read(fd[0], &c, 1) == 1);
+		close(fd[0]);
+		if(restored) { continue; }
+
+		/* The child has quit, so do we. */
+		exit(WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+	}
+}
+
+void snapshot_restore() {
+	if(depth == 0) {
+		printf("No snapshot is taken\n");
+		return;
+	}
+	char c = 'R';
+	flush_output();
+	if(write(restore_fd, &c, 1) != 1) {
+		perror("write");
+		return;
+	}
+	exit(0);
+}
@@ -0,0 +1,173 @@
+#!/bin/bash
+
+# Run the testcases in parallel with `nemu --batch', append the results
+# to a history file, and flag the performance regressions against a
+# baseline. The programs are obj/testcase/* by default, and a smoke run
+# of the kernel with the game when both are built. The benchmarks of
+# `make bench' are run by naming them (syscall, if built, needs the
+# kernel and is left out):
+#   bash regress.sh $(ls obj/testcase/bench/* | grep -v '\.' | grep -v syscall)
+#
+# Each result is a CSV line of the history:
+#   date,commit,program,status,exit_code,instructions,wall_time,mips,max_rss_kb
+# and the baseline is a file of the same format (see -s).
+
+usage() {
+	cat <<EOF
+Usage: $0 [OPTION...] [program...]
+  -j JOBS      number of runs at the same time (default: the number of cores)
+  -o FILE      append the results to FILE (default: regress-history.csv)
+  -b FILE      compare with the baseline FILE (default: regress-baseline.csv)
+  -s           save the results as the baseline
+  -t PCT       flag a run PCT percent slower than the baseline (default: 10)
+  -r PCT       flag a peak RSS PCT percent larger than the baseline (default: 20)
+  -i PCT       flag PCT percent more instructions than the baseline (default: 0)
+  -m SEC       do not compare the time of runs shorter than SEC (default: 0.05)
+  -l N         instructions of the kernel smoke run (default: 50000000)
+  -T SEC       time limit of each run (default: 600)
+EOF
+}
+
+nemu=$(pwd)/obj/nemu/nemu
+jobs=$(nproc)
+history=regress-history.csv
+baseline=regress-baseline.csv
+save_baseline=0
+time_pct=10
+rss_pct=20
+instr_pct=0
+min_time=0.05
+smoke_limit=50000000
+time_limit=600
+
+while getopts "j:o:b:st:r:i:m:l:T:h" opt; do
+	case $opt in
+		j) jobs=$OPTARG ;;
+		o) history=$OPTARG ;;
+		b) baseline=$OPTARG ;;
+		s) save_baseline=1 ;;
+		t) time_pct=$OPTARG ;;
+		r) rss_pct=$OPTARG ;;
+		i) instr_pct=$OPTARG ;;
+		m) min_time=$OPTARG ;;
+		l) smoke_limit=$OPTARG ;;
+		T) time_limit=$OPTARG ;;
+		h) usage; exit 0 ;;
+		*) usage; exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+test -x $nemu || { echo "$nemu is not built, run 'make nemu'"; exit 1; }
+
+programs=("$@")
+if [ ${#programs[@]} -eq 0 ]; then
+	for f in obj/testcase/*; do
+		case $f in *.o|*.d|*.txt|*-linux) continue ;; esac
+		test -f $f -a -x $f && programs+=($f)
+	done
+	if [ -f obj/kernel/kernel -a -f obj/game/game ]; then
+		programs+=(kernel+game)
+	fi
+fi
+
+date=$(date -u +%Y-%m-%dT%H:%M:%SZ)
+commit=$(git rev-parse --short HEAD 2> /dev/null || echo unknown)
+work=$(mktemp -d)
+trap "rm -rf $work" EXIT
+
+# value of a field in the JSON line of nemu --batch
+field() {
+	sed -n 's/.*"'$1'":"\{0,1\}\([^",}]*\).*/\1/p' <<< "$2"
+}
+
+# run_one INDEX PROGRAM: write the CSV line of the run to $work/INDEX.csv
+run_one() {
+	local dir=$work/run-$1 prog=$2 args
+	mkdir -p $dir
+	if [ "$prog" = kernel+game ]; then
+		# the kernel is the entry, and loads the game from the ramdisk
+		objcopy -S -O binary obj/kernel/kernel $dir/entry
+		args="--max-instr=$smoke_limit $(pwd)/obj/game/game"
+	else
+		args="--elf $(realpath $prog)"
+	fi
+
+	(cd $dir && timeout $time_limit $nemu --batch $args > out.txt 2>&1) 2> /dev/null
+	local ret=$? json=$(grep '^{"program"' $dir/out.txt | tail -n 1)
+	local status=$(field status "$json")
+	if [ $ret -eq 124 ]; then status=timeout
+	elif [ -z "$json" ]; then status=crash
+	fi
+	if [ "$prog" = kernel+game -a "$status" = limit ]; then status=good; fi
+
+	echo "$date,$commit,$prog,$status,$(field exit_code "$json"),$(field instructions "$json")," \
+		"$(field wall_time "$json"),$(field mips "$json"),$(field max_rss_kb "$json")" | tr -d ' ' > $work/$1.csv
+	if [ "$status" != good ]; then
+		cp $dir/out.txt $work/$1.log
+	fi
+	rm -rf $dir
+}
+
+i=0
+for prog in "${programs[@]}"; do
+	while [ $(jobs -rp | wc -l) -ge $jobs ]; do wait -n; done
+	run_one $(printf "%04d" $i) $prog &
+	i=$((i + 1))
+done
+wait
+
+results=$work/results.csv
+cat $work/[0-9]*.csv > $results
+
+header="date,commit,program,status,exit_code,instructions,wall_time,mips,max_rss_kb"
+test -s $history || echo $header > $history
+cat $results >> $history
+
+touch $work/empty.csv
+base=$baseline
+test -f $base || base=$work/empty.csv
+
+awk -F, -v time_pct=$time_pct -v rss_pct=$rss_pct -v instr_pct=$instr_pct -v min_time=$min_time '
+	FILENAME == ARGV[1] {
+		if($3 != "program") { bt[$3] = $7; br[$3] = $9; bi[$3] = $6; }
+		next;
+	}
+	BEGIN {
+		printf("%-32s %-8s %14s %10s %9s %10s  %s\n", "program", "status", "instructions", "time(s)", "MIPS", "RSS(KB)", "notes");
+	}
+	{
+		note = "";
+		if($4 != "good") { note = "FAIL"; nr_fail ++; }
+		else if($3 in bt) {
+			if(bt[$3] >= min_time && $7 > bt[$3] * (1 + time_pct / 100)) {
+				note = note sprintf(" time +%.1f%%", ($7 / bt[$3] - 1) * 100);
+			}
+			if(br[$3] > 0 && $9 > br[$3] * (1 + rss_pct / 100)) {
+				note = note sprintf(" rss +%.1f%%", ($9 / br[$3] - 1) * 100);
+			}
+			if(bi[$3] > 0 && $6 > bi[$3] * (1 + instr_pct / 100)) {
+				note = note sprintf(" instructions +%.1f%%", ($6 / bi[$3] - 1) * 100);
+			}
+			if(note != "") { note = "REGRESSION" note; nr_reg ++; }
+		}
+		printf("%-32s %-8s %14s %10s %9s %10s  %s\n", $3, $4, $6, $7, $8, $9, note);
+	}
+	END {
+		printf("\n%d runs, %d failed, %d regressed\n", FNR, nr_fail, nr_reg);
+		exit(nr_fail + nr_reg > 0);
+	}' $base $results
+ret=$?
+
+for log in $work/*.log; do
+	test -f $log || continue
+	prog=$(cut -d, -f3 $work/$(basename $log .log).csv)
+	echo -e "\n===== $prog =====" && tail -n 20 $log
+done
+
+if [ $save_baseline -eq 1 ]; then
+	(echo $header; cat $results) > $baseline
+	echo "Saved the baseline to $baseline"
+fi
+
+exit $ret
@@ -1,12 +1,11 @@
 #!/bin/bash
 
 nemu=obj/nemu/nemu
-cmd="c\nq"
 
 for file in $@; do
 	printf "[$file]"
 	logfile=`basename $file`-log.txt
-	echo -e $cmd | /usr/bin/time -f '%e' -o time.log $nemu $file &> $logfile
+	/usr/bin/time -f '%e' -o time.log $nemu --batch $file &> $logfile
 	time_cost=`cat time.log`
 	printf "($time_cost s): "
 	rm time.log
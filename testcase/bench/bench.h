@@ -0,0 +1,23 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include "trap.h"
+
+/* Every size of the benchmarks is multiplied by BENCH_SCALE, and each
+ * one can also be set alone with -D, see testcase/Makefile.part.
+ */
+#ifndef BENCH_SCALE
+#define BENCH_SCALE 1
+#endif
+
+#define NOINLINE __attribute__((noinline))
+
+/* The generator of the input data. The seed is fixed, so that every run
+ * executes the same instructions.
+ */
+static inline unsigned bench_rand(unsigned *seed) {
+	*seed = *seed * 1103515245u + 12345u;
+	return *seed >> 16;
+}
+
+#endif
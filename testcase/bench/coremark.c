@@ -0,0 +1,268 @@
+#include "bench.h"
+#include <stddef.h>
+
+/* Integer kernels in the style of CoreMark: sorting a linked list,
+ * matrix multiplication, a state machine scanning numbers in a string,
+ * and CRC-16. Each kernel checks its result by another way of computing
+ * it, so the check holds for every size.
+ */
+
+#ifndef CM_ITERS
+#define CM_ITERS (20 * BENCH_SCALE)
+#endif
+
+#ifndef CM_LIST_N
+#define CM_LIST_N 1000
+#endif
+
+#ifndef CM_MATRIX_N
+#define CM_MATRIX_N 32
+#endif
+
+#ifndef CM_STATE_N
+#define CM_STATE_N 400
+#endif
+
+static unsigned seed = 1;
+
+/* the CRC-16/CCITT of the results of all kernels */
+static unsigned short crc;
+
+NOINLINE unsigned short crc16_bitwise(unsigned char data, unsigned short crc) {
+	int i;
+	for(i = 0; i < 8; i ++) {
+		crc = ((crc >> 15) ^ ((data >> (7 - i)) & 1) ? (crc << 1) ^ 0x1021 : crc << 1);
+	}
+	return crc;
+}
+
+static unsigned short crc_table[256];
+
+static void init_crc_table() {
+	int i, j;
+	for(i = 0; i < 256; i ++) {
+		unsigned short c = i << 8;
+		for(j = 0; j < 8; j ++) {
+			c = (c & 0x8000 ? (c << 1) ^ 0x1021 : c << 1);
+		}
+		crc_table[i] = c;
+	}
+}
+
+static void crc_word(unsigned w) {
+	int i;
+	for(i = 0; i < 4; i ++, w >>= 8) {
+		unsigned short c = crc16_bitwise(w & 0xff, crc);
+		crc = (crc << 8) ^ crc_table[((crc >> 8) ^ w) & 0xff];
+		nemu_assert(c == crc);
+	}
+}
+
+
+/* linked list */
+
+typedef struct node {
+	struct node *next;
+	int data;
+	int idx;
+} Node;
+
+static Node nodes[CM_LIST_N];
+
+/* bottom-up merge sort by `data', then by `idx' */
+NOINLINE Node *list_sort(Node *list, int by_idx) {
+	int k, nmerges;
+	for(k = 1; ; k <<= 1) {
+		Node *p = list, *tail = NULL;
+		list = NULL;
+		nmerges = 0;
+		while(p != NULL) {
+			Node *q = p;
+			int psize = 0, qsize = k;
+			nmerges ++;
+			while(psize < k && q != NULL) {
+				psize ++;
+				q = q->next;
+			}
+			while(psize > 0 || (qsize > 0 && q != NULL)) {
+				Node *e;
+				if(psize == 0) { e = q; q = q->next; qsize --; }
+				else if(qsize == 0 || q == NULL) { e = p; p = p->next; psize --; }
+				else if((by_idx ? p->idx - q->idx : p->data - q->data) <= 0) { e = p; p = p->next; psize --; }
+				else { e = q; q = q->next; qsize --; }
+
+				if(tail != NULL) { tail->next = e; }
+				else { list = e; }
+				tail = e;
+			}
+			p = q;
+		}
+		tail->next = NULL;
+		if(nmerges <= 1) {
+			return list;
+		}
+	}
+}
+
+NOINLINE Node *list_reverse(Node *list) {
+	Node *prev = NULL;
+	while(list != NULL) {
+		Node *next = list->next;
+		list->next = prev;
+		prev = list;
+		list = next;
+	}
+	return prev;
+}
+
+static void bench_list() {
+	int i, sum = 0;
+	for(i = 0; i < CM_LIST_N; i ++) {
+		nodes[i].next = (i + 1 < CM_LIST_N ? &nodes[i + 1] : NULL);
+		nodes[i].data = bench_rand(&seed) & 0x7fff;
+		nodes[i].idx = i;
+		sum += nodes[i].data;
+	}
+
+	Node *list = list_sort(&nodes[0], 0);
+	Node *p;
+	int n = 0, prev = -1;
+	for(p = list; p != NULL; p = p->next, n ++) {
+		nemu_assert(p->data >= prev);
+		prev = p->data;
+		sum -= p->data;
+	}
+	nemu_assert(n == CM_LIST_N && sum == 0);
+	crc_word(list->data);
+
+	list = list_sort(list_reverse(list), 1);
+	for(p = list, i = 0; p != NULL; p = p->next, i ++) {
+		nemu_assert(p == &nodes[i]);
+	}
+	nemu_assert(i == CM_LIST_N);
+}
+
+
+/* matrix */
+
+static int A[CM_MATRIX_N][CM_MATRIX_N], B[CM_MATRIX_N][CM_MATRIX_N], C[CM_MATRIX_N][CM_MATRIX_N];
+
+NOINLINE void matrix_mul() {
+	int i, j, k;
+	for(i = 0; i < CM_MATRIX_N; i ++) {
+		for(j = 0; j < CM_MATRIX_N; j ++) {
+			int s = 0;
+			for(k = 0; k < CM_MATRIX_N; k ++) {
+				s += A[i][k] * B[k][j];
+			}
+			C[i][j] = s;
+		}
+	}
+}
+
+static void mat_vec(int M[CM_MATRIX_N][CM_MATRIX_N], int *x, int *y) {
+	int i, k;
+	for(i = 0; i < CM_MATRIX_N; i ++) {
+		int s = 0;
+		for(k = 0; k < CM_MATRIX_N; k ++) {
+			s += M[i][k] * x[k];
+		}
+		y[i] = s;
+	}
+}
+
+static void bench_matrix() {
+	int i, j;
+	for(i = 0; i < CM_MATRIX_N; i ++) {
+		for(j = 0; j < CM_MATRIX_N; j ++) {
+			A[i][j] = (bench_rand(&seed) & 0xff) - 128;
+			B[i][j] = (bench_rand(&seed) & 0xff) - 128;
+		}
+	}
+	matrix_mul();
+
+	/* C * x == A * (B * x) for a random x */
+	int x[CM_MATRIX_N], y[CM_MATRIX_N], Bx[CM_MATRIX_N], ABx[CM_MATRIX_N];
+	for(i = 0; i < CM_MATRIX_N; i ++) {
+		x[i] = bench_rand(&seed) & 0xff;
+	}
+	mat_vec(C, x, y);
+	mat_vec(B, x, Bx);
+	mat_vec(A, Bx, ABx);
+	for(i = 0; i < CM_MATRIX_N; i ++) {
+		nemu_assert(y[i] == ABx[i]);
+		crc_word(y[i]);
+	}
+}
+
+
+/* state machine */
+
+enum { S_START, S_INT, S_FLOAT, S_EXP, S_SCI, S_INVALID, NR_STATE };
+
+static char text[CM_STATE_N * 12 + 1];
+
+static void gen_number(char **s, int kind) {
+	int n = 1 + bench_rand(&seed) % 4, i;
+	for(i = 0; i < n; i ++) { *(*s) ++ = '0' + bench_rand(&seed) % 10; }
+	switch(kind) {
+		case S_INT: break;
+		case S_FLOAT: *(*s) ++ = '.'; *(*s) ++ = '5'; break;
+		case S_SCI: *(*s) ++ = 'e'; *(*s) ++ = '1' + bench_rand(&seed) % 9; break;
+		case S_INVALID: *(*s) ++ = 'x'; break;
+	}
+	*(*s) ++ = ',';
+}
+
+/* the kind of each number in the text, separated by ',' */
+NOINLINE void scan(const char *s, int *count) {
+	int state = S_START;
+	for(; *s; s ++) {
+		char c = *s;
+		if(c == ',') {
+			count[state] ++;
+			state = S_START;
+			continue;
+		}
+		int digit = (c >= '0' && c <= '9');
+		switch(state) {
+			case S_START: state = (digit ? S_INT : S_INVALID); break;
+			case S_INT: state = (digit ? S_INT : c == '.' ? S_FLOAT : c == 'e' ? S_EXP : S_INVALID); break;
+			case S_FLOAT: state = (digit ? S_FLOAT : c == 'e' ? S_EXP : S_INVALID); break;
+			case S_EXP: state = (digit ? S_SCI : S_INVALID); break;
+			case S_SCI: state = (digit ? S_SCI : S_INVALID); break;
+		}
+	}
+}
+
+static void bench_state() {
+	int expected[NR_STATE] = { 0 }, count[NR_STATE] = { 0 };
+	char *s = text;
+	const int kinds[] = { S_INT, S_FLOAT, S_SCI, S_INVALID };
+	int i;
+	for(i = 0; i < CM_STATE_N; i ++) {
+		int kind = kinds[bench_rand(&seed) % 4];
+		gen_number(&s, kind);
+		expected[kind] ++;
+	}
+	*s = '\0';
+
+	scan(text, count);
+	for(i = 0; i < NR_STATE; i ++) {
+		nemu_assert(count[i] == expected[i]);
+		crc_word(count[i]);
+	}
+}
+
+int main() {
+	init_crc_table();
+
+	int i;
+	for(i = 0; i < CM_ITERS; i ++) {
+		bench_list();
+		bench_matrix();
+		bench_state();
+	}
+
+	return 0;
+}
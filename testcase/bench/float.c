@@ -0,0 +1,79 @@
+#include "bench.h"
+#include "FLOAT.h"
+
+/* Numeric kernels with FLOAT: Simpson's rule, Newton's method, and a dot
+ * product. The results are checked with their known values.
+ */
+
+#ifndef FLOAT_ROUNDS
+#define FLOAT_ROUNDS (10 * BENCH_SCALE)
+#endif
+
+#ifndef FLOAT_N
+#define FLOAT_N 1000
+#endif
+
+static FLOAT f(FLOAT x) {
+	/* f(x) = 4/(1+x^2) */
+	return F_div_F(int2F(4), int2F(1) + F_mul_F(x, x));
+}
+
+/* The integral of f(x) on [0, 1] is pi. The sum is divided by blocks
+ * of intervals to stay in the range of FLOAT.
+ */
+NOINLINE FLOAT simpson(int n) {
+	FLOAT s = 0;
+	int blk, k;
+	for(blk = 0; blk < n; blk += 50) {
+		int end = (blk + 50 < n ? blk + 50 : n);
+		FLOAT t = f(F_div_int(int2F(2 * blk), 2 * n)) + f(F_div_int(int2F(2 * end), 2 * n));
+		for(k = 2 * blk + 1; k < 2 * end; k ++) {
+			t += F_mul_int(f(F_div_int(int2F(k), 2 * n)), (k & 1) ? 4 : 2);
+		}
+		s += F_div_int(t, 6 * n);
+	}
+	return s;
+}
+
+NOINLINE FLOAT newton_sqrt(FLOAT a) {
+	FLOAT x = a;
+	int i;
+	for(i = 0; i < 20; i ++) {
+		x = F_div_int(x + F_div_F(a, x), 2);
+	}
+	return x;
+}
+
+static FLOAT u[FLOAT_N], v[FLOAT_N];
+
+NOINLINE FLOAT dot(int n) {
+	FLOAT s = 0;
+	int i;
+	for(i = 0; i < n; i ++) {
+		s += F_mul_F(u[i], v[i]);
+	}
+	return s;
+}
+
+int main() {
+	int i, round;
+	for(round = 0; round < FLOAT_ROUNDS; round ++) {
+		FLOAT pi = simpson(FLOAT_N / 2);
+		nemu_assert(Fabs(pi - f2F(3.141593)) < f2F(1e-3));
+
+		for(i = 1; i <= 100; i ++) {
+			FLOAT r = newton_sqrt(int2F(i));
+			nemu_assert(Fabs(F_mul_F(r, r) - int2F(i)) < f2F(1e-2) * i);
+		}
+
+		/* u[i] = i/n, v[i] = 1/2, so the sum is about (n - 1)/4 */
+		for(i = 0; i < FLOAT_N; i ++) {
+			u[i] = F_div_int(int2F(i), FLOAT_N);
+			v[i] = f2F(0.5);
+		}
+		FLOAT d = dot(FLOAT_N);
+		nemu_assert(Fabs(d - F_div_int(int2F(FLOAT_N - 1), 4)) < f2F(1e-3) * FLOAT_N);
+	}
+
+	return 0;
+}
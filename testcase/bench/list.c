@@ -0,0 +1,61 @@
+#include "bench.h"
+
+/* Pointer chasing. The nodes are linked in a random cycle, so that each
+ * load depends on the previous one and the addresses have no pattern.
+ * Walking the whole cycle visits every node once.
+ */
+
+#ifndef LIST_N
+#define LIST_N (16 * 1024)
+#endif
+
+#ifndef LIST_ROUNDS
+#define LIST_ROUNDS (16 * BENCH_SCALE)
+#endif
+
+typedef struct node {
+	struct node *next;
+	int val;
+	int pad[6];		/* one node in a 32-byte line */
+} Node;
+
+static Node nodes[LIST_N];
+static int perm[LIST_N];
+
+NOINLINE Node *chase(Node *p, int n, int *sum) {
+	int s = 0;
+	while(n --) {
+		s += p->val;
+		p = p->next;
+	}
+	*sum += s;
+	return p;
+}
+
+int main() {
+	unsigned seed = 1;
+	int i;
+
+	/* Sattolo's algorithm gives a permutation of one cycle */
+	for(i = 0; i < LIST_N; i ++) {
+		perm[i] = i;
+	}
+	for(i = LIST_N - 1; i > 0; i --) {
+		int j = (bench_rand(&seed) << 16 | bench_rand(&seed)) % i;
+		int t = perm[i]; perm[i] = perm[j]; perm[j] = t;
+	}
+	for(i = 0; i < LIST_N; i ++) {
+		nodes[i].next = &nodes[perm[i]];
+		nodes[i].val = i;
+	}
+
+	Node *p = &nodes[0];
+	for(i = 0; i < LIST_ROUNDS; i ++) {
+		int sum = 0;
+		p = chase(p, LIST_N, &sum);
+		nemu_assert(p == &nodes[0]);
+		nemu_assert(sum == (LIST_N - 1) * LIST_N / 2);
+	}
+
+	return 0;
+}
@@ -0,0 +1,68 @@
+#include "bench.h"
+
+/* The four kernels of STREAM (copy, scale, add and triad) on integer
+ * arrays. Every element goes through the same operations, so the result
+ * is checked with the operations on one scalar.
+ */
+
+#ifndef STREAM_N
+#define STREAM_N (64 * 1024)
+#endif
+
+#ifndef STREAM_TIMES
+#define STREAM_TIMES (10 * BENCH_SCALE)
+#endif
+
+#define SCALAR 3
+
+static unsigned a[STREAM_N], b[STREAM_N], c[STREAM_N];
+
+NOINLINE void copy() {
+	int j;
+	for(j = 0; j < STREAM_N; j ++) { c[j] = a[j]; }
+}
+
+NOINLINE void scale() {
+	int j;
+	for(j = 0; j < STREAM_N; j ++) { b[j] = SCALAR * c[j]; }
+}
+
+NOINLINE void add() {
+	int j;
+	for(j = 0; j < STREAM_N; j ++) { c[j] = a[j] + b[j]; }
+}
+
+NOINLINE void triad() {
+	int j;
+	for(j = 0; j < STREAM_N; j ++) { a[j] = b[j] + SCALAR * c[j]; }
+}
+
+int main() {
+	int j, k;
+	for(j = 0; j < STREAM_N; j ++) {
+		a[j] = 1;
+		b[j] = 2;
+		c[j] = 0;
+	}
+
+	unsigned aj = 1, bj = 2, cj = 0;
+	for(k = 0; k < STREAM_TIMES; k ++) {
+		copy();
+		scale();
+		add();
+		triad();
+
+		cj = aj;
+		bj = SCALAR * cj;
+		cj = aj + bj;
+		aj = bj + SCALAR * cj;
+	}
+
+	for(j = 0; j < STREAM_N; j ++) {
+		nemu_assert(a[j] == aj);
+		nemu_assert(b[j] == bj);
+		nemu_assert(c[j] == cj);
+	}
+
+	return 0;
+}
@@ -0,0 +1,114 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* String-heavy code with the string functions of the C library: sorting
+ * words with strcmp(), building a text and searching it with strstr(),
+ * and converting numbers with sprintf() and atoi().
+ */
+
+#ifndef STR_ROUNDS
+#define STR_ROUNDS (10 * BENCH_SCALE)
+#endif
+
+#ifndef STR_WORDS
+#define STR_WORDS 500
+#endif
+
+#ifndef STR_NUMBERS
+#define STR_NUMBERS 1000
+#endif
+
+#define MAX_WORD_LEN 12
+#define KEY "nemu"
+#define KEY_EVERY 7
+
+static unsigned seed = 1;
+
+static char pool[STR_WORDS][MAX_WORD_LEN + 1];
+static char *words[STR_WORDS];
+static char text[STR_WORDS * (MAX_WORD_LEN + 1) + (STR_WORDS / KEY_EVERY + 1) * sizeof(KEY) + 1];
+
+/* The words are made of 'a' to 'm', so that they never contain the key. */
+static void gen_words() {
+	int i, j;
+	for(i = 0; i < STR_WORDS; i ++) {
+		int len = 3 + bench_rand(&seed) % (MAX_WORD_LEN - 2);
+		for(j = 0; j < len; j ++) {
+			pool[i][j] = 'a' + bench_rand(&seed) % 13;
+		}
+		pool[i][len] = '\0';
+		words[i] = pool[i];
+	}
+}
+
+NOINLINE void sort_words() {
+	int gap, i, j;
+	for(gap = STR_WORDS / 2; gap > 0; gap /= 2) {
+		for(i = gap; i < STR_WORDS; i ++) {
+			char *w = words[i];
+			for(j = i; j >= gap && strcmp(words[j - gap], w) > 0; j -= gap) {
+				words[j] = words[j - gap];
+			}
+			words[j] = w;
+		}
+	}
+}
+
+/* join the words with ' ', and the key after every KEY_EVERY words */
+NOINLINE int build_text() {
+	char *p = text;
+	int i, nr_key = 0;
+	for(i = 0; i < STR_WORDS; i ++) {
+		strcpy(p, words[i]);
+		p += strlen(p);
+		*p ++ = ' ';
+		if(i % KEY_EVERY == 0) {
+			memcpy(p, KEY " ", sizeof(KEY));
+			p += sizeof(KEY);
+			nr_key ++;
+		}
+	}
+	*p = '\0';
+	return nr_key;
+}
+
+NOINLINE int count_key() {
+	int n = 0;
+	const char *p = text;
+	while((p = strstr(p, KEY)) != NULL) {
+		n ++;
+		p += strlen(KEY);
+	}
+	return n;
+}
+
+NOINLINE void convert_numbers() {
+	char buf[16];
+	int i;
+	for(i = 0; i < STR_NUMBERS; i ++) {
+		int x = (int)(bench_rand(&seed) << 16 | bench_rand(&seed));
+		sprintf(buf, "%d", x);
+		nemu_assert(atoi(buf) == x);
+	}
+}
+
+int main() {
+	int i, round;
+	for(round = 0; round < STR_ROUNDS; round ++) {
+		gen_words();
+		sort_words();
+		for(i = 1; i < STR_WORDS; i ++) {
+			nemu_assert(strcmp(words[i - 1], words[i]) <= 0);
+		}
+
+		int nr_key = build_text();
+		nemu_assert(strlen(text) < sizeof(text));
+		nemu_assert(count_key() == nr_key);
+
+		convert_numbers();
+	}
+
+	return 0;
+}
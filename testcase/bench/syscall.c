@@ -0,0 +1,31 @@
+#include "bench.h"
+#include <sys/syscall.h>
+
+/* System calls in a loop, to measure the cost of `int $0x80', the IDT
+ * and the trap frame in NEMU. It needs the kernel, so run it from the
+ * ramdisk with the kernel as `entry', not with --elf. brk() is used, as
+ * the kernel handles it without any device.
+ */
+
+#ifndef SYSCALL_N
+#define SYSCALL_N (20000 * BENCH_SCALE)
+#endif
+
+static inline unsigned sys_brk(unsigned addr) {
+	unsigned ret;
+	asm volatile ("int $0x80" : "=a"(ret) : "a"(SYS_brk), "b"(addr) : "memory");
+	return ret;
+}
+
+int main() {
+	/* brk(0) fails and returns the current break */
+	unsigned cur = sys_brk(0);
+	int i;
+	for(i = 0; i < SYSCALL_N; i ++) {
+		nemu_assert(sys_brk(0) == cur);
+		nemu_assert(sys_brk(cur + 4096) == cur + 4096);
+		nemu_assert(sys_brk(cur) == cur);
+	}
+
+	return 0;
+}